@@ -6,105 +6,96 @@ See the included LICENSE file
 #pragma once
 
 #include "NifFile.hpp"
+#include "RefSkeleton.hpp"
+#include "SkinWeights.hpp"
 
 #include <map>
+#include <memory>
 
-struct VertexBoneWeights {
-	std::vector<uint8_t> boneIds;
-	std::vector<float> weights;
-
-	void Add(const uint8_t inBoneId, const float inWeight) {
-		if (inWeight == 0.0f)
-			return;
-
-		for (size_t i = 0; i < weights.size(); ++i) {
-			if (inWeight < weights[i])
-				continue;
-
-			weights.insert(weights.begin() + i, inWeight);
-			boneIds.insert(boneIds.begin() + i, inBoneId);
-			return;
-		}
-
-		weights.push_back(inWeight);
-		boneIds.push_back(inBoneId);
-	}
-};
+class NifBlockIndex;
 
 class AnimBone {
 public:
 	std::string boneName = "bogus"; // bone names are node names in the nif file
 	bool isStandardBone = false;
-	AnimBone* parent = nullptr;
-	std::vector<AnimBone*> children;
-	// xformToGlobal: transforms from this bone's CS to the global CS.
-	nifly::MatTransform xformToGlobal;
+	int id = -1;	 // index of this bone in the skeleton
+	int parent = -1; // bone ID of the parent, -1 for none
+	std::vector<int> children;
 	// xformToParent: transforms from this bone's CS to its parent's CS.
 	nifly::MatTransform xformToParent;
 	// pose rotation and translation vectors
 	nifly::Vector3 poseRotVec, poseTranVec;
-	nifly::MatTransform xformPoseToGlobal;
 
 	int refCount = 0; // reference count of this bone
 
-	AnimBone& LoadFromNif(nifly::NifFile* skeletonNif, int srcBlock, AnimBone* parent = nullptr);
-	// AddToNif adds this bone to the given nif, as well as its parent
+	AnimBone* GetParent() const;
+	// AddToNif adds this bone to the nif of the index, as well as its parent
 	// if missing, recursively.  The new bone's NiNode is returned.
-	nifly::NiNode* AddToNif(nifly::NifFile* nif) const;
-	// SetTransformBoneToParent sets xformToParent and updates xformToGlobal
-	// and xformPoseToGlobal, for this and for descendants.
+	nifly::NiNode* AddToNif(NifBlockIndex& blockIndex) const;
+	// GetTransformToGlobal returns the transform from this bone's CS to the
+	// global CS.  GetPoseTransformToGlobal returns the same for the pose.
+	// Both are worked out when asked for, after resolving the parents.
+	const nifly::MatTransform& GetTransformToGlobal() const;
+	const nifly::MatTransform& GetPoseTransformToGlobal() const;
+	// SetTransformBoneToParent sets xformToParent and invalidates the
+	// global transforms of this and of descendants.
 	void SetTransformBoneToParent(const nifly::MatTransform& ttp);
-	// UpdateTransformToGlobal updates xformToGlobal for this and for
-	// descendants.  This should only be called from itself,
-	// SetTransformBoneToParent, and SetParentBone.
-	void UpdateTransformToGlobal();
-	// UpdatePoseTransform updates xformPoseToGlobal for this and all
-	// descendants.  Call it after poseRotVec, poseTranVec, or
-	// xformToGlobal is changed.
-	void UpdatePoseTransform();
+	// InvalidateTransforms marks the global transforms of this and all
+	// descendants as out of date.  Call it after poseRotVec or poseTranVec
+	// is changed.  Stops at bones that are out of date already, since
+	// their descendants are as well.
+	void InvalidateTransforms();
 	// SetParentBone updates "parent" of this and "children" of the old
-	// and new parents.  It also calls UpdateTransformToGlobal and
-	// UpdatePoseTranform.
-	void SetParentBone(AnimBone* newParent);
+	// and new parents.  It also calls InvalidateTransforms.
+	void SetParentBone(int newParent);
+
+private:
+	friend class AnimSkeleton;
+
+	// Caches of the global transforms, only valid while transformsValid is set
+	mutable nifly::MatTransform xformToGlobal;
+	mutable nifly::MatTransform xformPoseToGlobal;
+	mutable bool transformsValid = false;
+
+	void ResolveTransforms() const;
 };
 
-// Vertex to weight value association. Also keeps track of skin-to-bone transform and bounding sphere.
+// Skin-to-bone transform and bounding sphere of a shape bone. The weights are in the SkinWeights of the skin.
 class AnimWeight {
 public:
-	std::unordered_map<uint16_t, float> weights;
 	nifly::MatTransform xformSkinToBone;
 	nifly::BoundingSphere bounds;
 
 	void LoadFromNif(nifly::NifFile* loadFromFile, nifly::NiShape* shape, const int& index);
 };
 
-// Bone to weight list association.
+// Bone to weight list association. Shape bone indices index both boneWeights and the rows of weights.
 class AnimSkin {
 public:
-	std::unordered_map<int, AnimWeight> boneWeights;
+	std::vector<AnimWeight> boneWeights;
+	SkinWeights weights;
 	std::unordered_map<std::string, int> boneNames;
 	nifly::MatTransform xformGlobalToSkin;
 
 	void LoadFromNif(nifly::NifFile* loadFromFile, nifly::NiShape* shape);
 
+	// Adds default entries up to the bone if it has none yet
+	AnimWeight& GetBoneWeight(int boneID) {
+		if (boneID >= static_cast<int>(boneWeights.size()))
+			boneWeights.resize(boneID + 1);
+		return boneWeights[boneID];
+	}
+
 	void RemoveBone(const std::string& boneName) {
 		auto bone = boneNames.find(boneName);
 		if (bone == boneNames.end())
 			return;
 
 		int boneID = bone->second;
-		std::unordered_map<int, AnimWeight> bwTemp;
-		for (auto& bw : boneWeights) {
-			if (bw.first > boneID)
-				bwTemp[bw.first - 1] = std::move(bw.second);
-			else if (bw.first < boneID)
-				bwTemp[bw.first] = std::move(bw.second);
-		}
-
-		boneWeights.clear();
+		if (boneID < static_cast<int>(boneWeights.size()))
+			boneWeights.erase(boneWeights.begin() + boneID);
 
-		for (auto& bw : bwTemp)
-			boneWeights[bw.first] = std::move(bw.second);
+		weights.RemoveBone(boneID);
 
 		boneNames.erase(boneName);
 		for (auto& bn : boneNames)
@@ -112,6 +103,9 @@ public:
 				bn.second--;
 	}
 
+	// Removes many bones with a single remap of the bone indices
+	void RemoveBones(const std::vector<std::string>& removeNames);
+
 	void InsertVertexIndices(const std::vector<uint16_t>& indices);
 };
 
@@ -126,6 +120,10 @@ public:
 	std::vector<std::vector<int>> vertBones;	 // Vert order list of bones per vertex.
 };
 
+// Exact bounds are the smallest spheres around the weighted vertices of a bone. Approximate bounds take
+// two linear passes per bone and are usually a few percent larger.
+enum class SkinBoundsMode { Exact, Approximate };
+
 /* Represents animation weighting to a common skeleton across multiple shapes, sourced from nif files*/
 class AnimInfo {
 private:
@@ -134,6 +132,7 @@ private:
 public:
 	std::map<std::string, std::vector<std::string>> shapeBones;
 	std::unordered_map<std::string, AnimSkin> shapeSkinning; // Shape to skin association.
+	SkinBoundsMode boundsMode = SkinBoundsMode::Exact;
 
 	nifly::NifFile* GetRefNif() { return refNif; };
 	const nifly::NifFile* GetRefNif() const { return refNif; };
@@ -142,6 +141,8 @@ public:
 	// Returns true if a new bone is added, false if the bone already exists.
 	bool AddShapeBone(const std::string& shape, const std::string& boneName);
 	bool RemoveShapeBone(const std::string& shape, const std::string& boneName);
+	// Same as RemoveShapeBone for each bone, but in one pass. Returns the number of bones removed.
+	int RemoveShapeBones(const std::string& shape, const std::vector<std::string>& boneNames);
 
 	void Clear();
 	void ClearShape(const std::string& shape);
@@ -153,7 +154,6 @@ public:
 	bool LoadFromNif(nifly::NifFile* nif);
 	bool LoadFromNif(nifly::NifFile* nif, nifly::NiShape* shape, bool newRefNif = true);
 	int GetShapeBoneIndex(const std::string& shapeName, const std::string& boneName) const;
-	std::unordered_map<uint16_t, float>* GetWeightsPtr(const std::string& shape, const std::string& boneName);
 	bool HasWeights(const std::string& shape, const std::string& boneName);
 	void GetWeights(const std::string& shape,
 					const std::string& boneName,
@@ -177,44 +177,76 @@ public:
 	// shape and updates all skin-to-bone transforms.
 	void ChangeGlobalToSkinTransform(const std::string& shape, const nifly::MatTransform& newTrans);
 	bool CalcShapeSkinBounds(const std::string& shapeName, const int& boneIndex);
-	void CleanupBones();
+	// Calculates the bounds of all bones of a shape from a single copy of its vertices. Bones with weights
+	// for vertices the shape doesn't have are left alone and marked as invalid in outBoneValid.
+	// The shape of the reference nif is looked up by name unless it's passed in.
+	bool CalcShapeSkinBounds(const std::string& shapeName,
+							 std::vector<bool>& outBoneValid,
+							 nifly::NiShape* shape = nullptr);
+	// Removes the bones without any influence from all shapes. Returns the shapes that lost bones.
+	std::vector<std::string> CleanupBones();
 	void WriteToNif(nifly::NifFile* nif, const std::string& shapeException = "");
 
 	void RenameShape(const std::string& shapeName, const std::string& newShapeName);
 };
 
 class AnimSkeleton {
-	std::map<std::string, AnimBone> allBones;
-	std::map<std::string, AnimBone> customBones;
-	std::string rootBone;
-	int unknownCount = 0;
+	// Bone names are interned to dense IDs that index the bone array. The standard bones of the
+	// reference skeleton come first and stay, the custom bones of the current file follow them.
+	std::vector<AnimBone> bones;
+	std::unordered_map<std::string, int> boneIds;
+	int standardBoneCount = 0;
+	int rootBone = -1;
+	std::shared_ptr<const RefSkeleton> reference;
 	bool allowCustomTransforms = true;
 
 	AnimSkeleton() {}
 
+	AnimBone& AddBone(const std::string& boneName, bool isStandardBone);
+
 public:
+	// Every thread gets its own skeleton so that files can be processed in parallel.
 	static AnimSkeleton& getInstance() {
-		static AnimSkeleton instance;
+		static thread_local AnimSkeleton instance;
 		return instance;
 	}
 
-	nifly::NifFile refSkeletonNif;
-
+	// Forgets the bones of the last file. The bones of the reference skeleton stay.
 	void Clear();
 
+	// Uses the shared reference skeleton for the standard bones. Does nothing if it's already in use.
+	void SetReference(std::shared_ptr<const RefSkeleton> skeleton);
+	const std::shared_ptr<const RefSkeleton>& GetReference() const { return reference; }
+
 	int LoadFromNif(const std::string& fileName);
 	AnimBone& AddStandardBone(const std::string& boneName);
 	AnimBone& AddCustomBone(const std::string& boneName);
-	std::string GenerateBoneName();
 	AnimBone* LoadCustomBoneFromNif(nifly::NifFile* nif, const std::string& boneName);
 
-	bool RefBone(const std::string& boneName);
-	bool ReleaseBone(const std::string& boneName);
-	int GetBoneRefCount(const std::string& boneName);
+	// Returns -1 if there is no bone with that name
+	int GetBoneId(const std::string& boneName) const {
+		auto it = boneIds.find(boneName);
+		return it != boneIds.end() ? it->second : -1;
+	}
+
+	// Bone references stay valid until a bone is added or the skeleton is cleared
+	AnimBone& GetBone(int id) { return bones[id]; }
+	const AnimBone& GetBone(int id) const { return bones[id]; }
+	int GetBoneCount() const { return static_cast<int>(bones.size()); }
+
+	bool RefBone(const std::string& boneName) { return RefBone(GetBoneId(boneName)); }
+	bool RefBone(int id);
+	bool ReleaseBone(const std::string& boneName) { return ReleaseBone(GetBoneId(boneName)); }
+	bool ReleaseBone(int id);
+	int GetBoneRefCount(const std::string& boneName) const { return GetBoneRefCount(GetBoneId(boneName)); }
+	int GetBoneRefCount(int id) const;
 
 	AnimBone* GetBonePtr(const std::string& boneName, const bool allowCustom = true);
 	AnimBone* GetRootBonePtr();
 	bool GetBoneTransformToGlobal(const std::string& boneName, nifly::MatTransform& xform);
+	// Brings the global transforms of all out of date bones up to date at once, a level of the
+	// hierarchy at a time with the batch transform kernels
+	void ResolveTransforms();
 
 	int GetActiveBoneNames(std::vector<std::string>& outBoneNames) const;
 	void DisableCustomTransforms();
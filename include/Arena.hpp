@@ -0,0 +1,58 @@
+/*
+SSE NIF Optimizer
+See the included LICENSE file
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Monotonic per-thread arena for the short-lived objects of one file.
+// While an ArenaScope is active, the global operator new of the thread bumps a pointer in memory owned
+// by that thread and operator delete only counts. The arena is reset in bulk when the outermost scope
+// ends. Allocations that are still alive at that point (e.g. lazily created statics) pin the memory of
+// that file instead, so nothing is ever reused while in use.
+namespace Arena {
+// Returns nullptr if the thread has no active arena or it's full, the caller falls back to the heap.
+// blockSize receives the memory taken from the arena.
+void* Allocate(size_t size, size_t& blockSize);
+
+// Returns false if the memory doesn't belong to an arena. Safe to call from any thread.
+bool Free(void* ptr, size_t& blockSize);
+
+// Memory of all files so far that stayed committed because an allocation outlived its file
+uint64_t GetPinnedBytes();
+} // namespace Arena
+
+// Serves all allocations of the calling thread from its arena until destroyed.
+// Scopes can be nested, only the outermost one resets the arena.
+class ArenaScope {
+public:
+	explicit ArenaScope(bool enabled = true);
+	~ArenaScope();
+
+	ArenaScope(const ArenaScope&) = delete;
+	ArenaScope& operator=(const ArenaScope&) = delete;
+
+	bool IsActive() const { return active; }
+
+	// Memory taken from the arena since the outermost scope started
+	size_t GetUsedBytes() const;
+
+private:
+	bool active = false;
+};
+
+// Sends allocations back to the heap while it exists, for objects that must outlive the arena scope.
+class ArenaPause {
+public:
+	ArenaPause();
+	~ArenaPause();
+
+	ArenaPause(const ArenaPause&) = delete;
+	ArenaPause& operator=(const ArenaPause&) = delete;
+
+private:
+	void* pausedSlice = nullptr;
+};
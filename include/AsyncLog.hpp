@@ -0,0 +1,63 @@
+/*
+SSE NIF Optimizer
+See the included LICENSE file
+*/
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Log file that doesn't make the caller wait for the disk.
+// Messages are copied into a ring buffer and a background thread writes them out in batches.
+// Write is thread-safe and every message ends up in the file in one piece.
+class AsyncLog {
+public:
+	static constexpr size_t DefaultCapacity = 1024 * 1024;
+
+	explicit AsyncLog(size_t capacity = DefaultCapacity);
+	~AsyncLog();
+
+	AsyncLog(const AsyncLog&) = delete;
+	AsyncLog& operator=(const AsyncLog&) = delete;
+
+	// Truncates the file and starts the writer thread.
+	bool Open(const std::string& fileName);
+	bool IsOpen() const { return writerThread.joinable(); }
+
+	// Writes everything that is still buffered and stops the writer thread.
+	void Close();
+
+	// Messages are ignored while no file is open.
+	void Write(const char* data, size_t size);
+	void Write(const std::string& msg) { Write(msg.data(), msg.size()); }
+	void WriteLine(const std::string& line, const char* lineEnd = "\r\n");
+
+	// Blocks until everything written before the call has been handed to the file.
+	void Flush();
+
+private:
+	std::fstream file;
+
+	std::vector<char> ring;
+	size_t batchBytes;
+	size_t readPos = 0;
+	size_t used = 0;
+	uint64_t queuedBytes = 0;
+	uint64_t writtenBytes = 0;
+	int flushRequests = 0;
+	bool writing = false;
+	bool stopping = false;
+
+	std::mutex mutex;
+	std::condition_variable dataCondition;
+	std::condition_variable spaceCondition;
+	std::thread writerThread;
+
+	void WriterLoop();
+};
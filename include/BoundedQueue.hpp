@@ -0,0 +1,86 @@
+/*
+SSE NIF Optimizer
+See the included LICENSE file
+*/
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+// Blocking multi-producer/multi-consumer queue.
+// Push blocks while either the item or the byte limit is reached. A single item is always
+// accepted by an empty queue, so items larger than the byte limit can't stall the queue.
+template<typename T>
+class BoundedQueue {
+public:
+	explicit BoundedQueue(size_t maxItems, size_t maxBytes = 0)
+		: maxItems(maxItems)
+		, maxBytes(maxBytes) {}
+
+	// Returns false if the queue was closed before the item could be added.
+	bool Push(T item, size_t bytes = 0) {
+		std::unique_lock<std::mutex> lock(mutex);
+		notFull.wait(lock, [&]() { return closed || items.empty() || HasRoom(bytes); });
+		if (closed)
+			return false;
+
+		items.push_back({std::move(item), bytes});
+		usedBytes += bytes;
+		lock.unlock();
+
+		notEmpty.notify_one();
+		return true;
+	}
+
+	// Returns false once the queue is closed and empty.
+	bool Pop(T& item) {
+		std::unique_lock<std::mutex> lock(mutex);
+		notEmpty.wait(lock, [&]() { return closed || !items.empty(); });
+		if (items.empty())
+			return false;
+
+		item = std::move(items.front().item);
+		usedBytes -= items.front().bytes;
+		items.pop_front();
+		lock.unlock();
+
+		notFull.notify_all();
+		return true;
+	}
+
+	// Wakes all waiting threads. Remaining items can still be popped.
+	void Close() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			closed = true;
+		}
+
+		notEmpty.notify_all();
+		notFull.notify_all();
+	}
+
+private:
+	struct Entry {
+		T item;
+		size_t bytes;
+	};
+
+	std::mutex mutex;
+	std::condition_variable notEmpty;
+	std::condition_variable notFull;
+	std::deque<Entry> items;
+	size_t maxItems = 0;
+	size_t maxBytes = 0;
+	size_t usedBytes = 0;
+	bool closed = false;
+
+	bool HasRoom(size_t bytes) const {
+		if (items.size() >= maxItems)
+			return false;
+		if (maxBytes > 0 && usedBytes + bytes > maxBytes)
+			return false;
+		return true;
+	}
+};
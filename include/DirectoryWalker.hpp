@@ -0,0 +1,64 @@
+/*
+SSE NIF Optimizer
+See the included LICENSE file
+*/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Searches directory trees in a single pass, with several threads working on different directories.
+// Every regular file is reported as soon as it's found, so that processing can start during the search.
+class DirectoryWalker {
+public:
+	// Called on the walker threads with the UTF-8 path and size of every file found
+	using FileCallback = std::function<void(const std::string& file, uint64_t fileSize)>;
+
+	// 0 uses a default suited for slow (network) file systems
+	explicit DirectoryWalker(size_t threadCount = 0);
+	~DirectoryWalker();
+
+	DirectoryWalker(const DirectoryWalker&) = delete;
+	DirectoryWalker& operator=(const DirectoryWalker&) = delete;
+
+	// Starts searching the folders in the background. onFinished is called on the last walker thread
+	// after all files were reported, also when the search was stopped.
+	void Start(const std::vector<std::string>& folders,
+			   bool recursive,
+			   FileCallback onFile,
+			   std::function<void()> onFinished = nullptr);
+
+	// Stops the search early. Directories that are being read are abandoned.
+	void Stop();
+
+	// Blocks until the search is finished.
+	void Wait();
+
+	// Searches the folders and returns once all files were reported.
+	static void Walk(const std::vector<std::string>& folders, bool recursive, const FileCallback& onFile);
+
+private:
+	size_t threadCount = 0;
+	bool recursive = true;
+	FileCallback onFile;
+	std::function<void()> onFinished;
+
+	std::mutex mutex;
+	std::condition_variable wakeCondition;
+	std::vector<std::filesystem::path> pendingDirs;
+	size_t busyThreads = 0;
+	size_t runningThreads = 0;
+	std::atomic<bool> stopping{false};
+	std::vector<std::thread> threads;
+
+	void WalkerLoop();
+	void ReadDirectory(const std::filesystem::path& dir, std::vector<std::filesystem::path>& subDirs);
+};
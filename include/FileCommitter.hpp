@@ -0,0 +1,53 @@
+/*
+SSE NIF Optimizer
+See the included LICENSE file
+*/
+
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+enum class SyncPolicy {
+	None,     // Leave flushing to the OS, renames are still atomic
+	EachFile, // Flush every file and its rename before moving on
+	Batched   // Flush and rename files in groups, far fewer waits for the disk
+};
+
+// Replaces files by writing a temporary file beside them and renaming it over the original.
+// A crash or cancel leaves either the old or the new file, never a truncated one.
+// Symbolic links are followed, the file they point to is replaced and the link kept. Files with more than
+// one hard link are overwritten in place instead, so that all of their links keep seeing the new contents.
+class FileCommitter {
+public:
+	explicit FileCommitter(SyncPolicy policy = SyncPolicy::None, size_t batchSize = 64);
+	~FileCommitter();
+
+	FileCommitter(const FileCommitter&) = delete;
+	FileCommitter& operator=(const FileCommitter&) = delete;
+
+	// Thread-safe. With batching, the file is only replaced once its batch is committed.
+	// Returns false if the file couldn't be written.
+	bool Write(const std::string& fileName, const char* data, size_t size);
+
+	// Replaces all files of the pending batch.
+	// Returns the files of all batches so far that were written but couldn't be replaced.
+	std::vector<std::string> Commit();
+
+private:
+	struct PendingFile {
+		std::string fileName;
+		std::string targetFileName; // With symbolic links resolved
+		std::string tempFileName;
+	};
+
+	SyncPolicy policy = SyncPolicy::None;
+	size_t batchSize = 0;
+
+	std::mutex mutex;
+	std::vector<PendingFile> pending;
+	std::vector<std::string> failed;
+
+	void CommitBatch(const std::vector<PendingFile>& batch);
+};
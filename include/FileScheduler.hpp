@@ -0,0 +1,44 @@
+/*
+SSE NIF Optimizer
+See the included LICENSE file
+*/
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Blocking queue that hands out the largest waiting file first.
+// Starting big files early keeps a single large mesh from becoming the tail of a run.
+// Files of the same size come out in the order they were added.
+class FileScheduler {
+public:
+	struct Entry {
+		std::string file;
+		uint64_t size = 0;
+		uint64_t order = 0;
+	};
+
+	void Push(const std::string& file, uint64_t size);
+
+	// Blocks until a file is waiting. Returns false once the scheduler is closed and empty.
+	bool Pop(Entry& entry);
+
+	// Returns false if no file is waiting.
+	bool TryPop(Entry& entry);
+
+	// Wakes all waiting threads. Remaining files can still be popped.
+	void Close();
+
+private:
+	std::mutex mutex;
+	std::condition_variable notEmpty;
+	std::vector<Entry> heap;
+	uint64_t nextOrder = 0;
+	bool closed = false;
+
+	void PopLargest(Entry& entry);
+};
@@ -0,0 +1,41 @@
+/*
+SSE NIF Optimizer
+See the included LICENSE file
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Read-only view of the contents of a file.
+// The file is memory-mapped so that nothing is copied until the data is used. If it can't be
+// mapped (or mapping isn't allowed), it's read into memory with an fstream instead.
+class FileView {
+public:
+	FileView() = default;
+	~FileView() { Close(); }
+
+	FileView(const FileView&) = delete;
+	FileView& operator=(const FileView&) = delete;
+
+	// Without a mapping, only the first maxReadBytes of the file are read.
+	bool Open(const std::string& fileName, bool allowMapping = true, size_t maxReadBytes = SIZE_MAX);
+
+	// Releases the mapping. Must be called before the file is written to.
+	void Close();
+
+	const char* GetData() const { return data; }
+	size_t GetSize() const { return size; }
+	bool IsMapped() const { return mapping != nullptr; }
+
+private:
+	void* mapping = nullptr;
+	std::vector<char> buffer;
+	const char* data = nullptr;
+	size_t size = 0;
+
+	bool Map(const std::string& fileName);
+	bool Read(const std::string& fileName, size_t maxReadBytes);
+};
@@ -0,0 +1,45 @@
+/*
+SSE NIF Optimizer
+See the included LICENSE file
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+// Fast non-cryptographic 64-bit hash for detecting changed file contents.
+// Consumes 8 bytes per step and finishes with the MurmurHash3 avalanche.
+inline uint64_t HashBytes(const void* data, size_t size, uint64_t seed = 0) {
+	constexpr uint64_t prime = 0x9E3779B97F4A7C15ull;
+
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	uint64_t hash = seed ^ (size * prime);
+
+	size_t i = 0;
+	for (; i + 8 <= size; i += 8) {
+		uint64_t word;
+		std::memcpy(&word, bytes + i, sizeof(word));
+		hash ^= word * prime;
+		hash = (hash << 31) | (hash >> 33);
+		hash *= 0xC2B2AE3D27D4EB4Full;
+	}
+
+	uint64_t tail = 0;
+	for (size_t shift = 0; i < size; i++, shift += 8)
+		tail |= static_cast<uint64_t>(bytes[i]) << shift;
+
+	hash ^= tail * prime;
+
+	hash ^= hash >> 33;
+	hash *= 0xFF51AFD7ED558CCDull;
+	hash ^= hash >> 33;
+	hash *= 0xC4CEB9FE1A85EC53ull;
+	hash ^= hash >> 33;
+	return hash;
+}
+
+inline uint64_t HashString(const std::string& str, uint64_t seed = 0) {
+	return HashBytes(str.data(), str.size(), seed);
+}
@@ -0,0 +1,103 @@
+/*
+SSE NIF Optimizer
+See the included LICENSE file
+*/
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+enum class Phase { Read, Load, OptimizeFor, SkinLoad, SkinWrite, Normals, Save, Write, Count };
+constexpr size_t PhaseCount = static_cast<size_t>(Phase::Count);
+
+const char* GetPhaseName(Phase phase);
+
+struct PhaseStats {
+	uint64_t nanoseconds = 0;
+	uint64_t peakBytes = 0; // Highest heap usage above the start of the phase
+	uint64_t allocations = 0;
+	uint64_t arenaAllocations = 0; // Part of the allocations that was served by the arena
+};
+
+struct FileStats {
+	PhaseStats phases[PhaseCount];
+	uint64_t bytesRead = 0;
+	uint64_t bytesWritten = 0;
+	uint32_t blockCount = 0;
+	uint64_t arenaBytes = 0; // Arena memory taken by the file, released in bulk afterwards
+
+	PhaseStats& operator[](Phase phase) { return phases[static_cast<size_t>(phase)]; }
+	const PhaseStats& operator[](Phase phase) const { return phases[static_cast<size_t>(phase)]; }
+
+	uint64_t GetTotalNanoseconds() const;
+};
+
+// Heap counters of the calling thread, kept up to date by the global operator new/delete of
+// CountingAllocator.cpp. Programs that don't link it (the GUI) keep the default allocator and zero counters.
+// Memory freed on another thread than it was allocated on is subtracted there.
+struct AllocCounters {
+	int64_t currentBytes;
+	int64_t peakBytes;
+	uint64_t allocations;
+	uint64_t arenaAllocations;
+};
+
+AllocCounters GetThreadAllocCounters();
+
+// Allocations are only counted and served from arenas if this is true
+bool IsCountingAllocatorLinked();
+
+namespace CountingAllocator {
+// Plain data only, so that no thread_local initialization runs inside operator new
+extern thread_local AllocCounters threadAllocs;
+
+// Set by CountingAllocator.cpp during static initialization
+extern bool linked;
+} // namespace CountingAllocator
+
+// Measures wall time and allocations of a phase on the calling thread until destroyed or stopped.
+// Timers can be nested, the peak of the outer phase includes the inner one.
+// The phase is also added to the trace if one is being recorded.
+class PhaseTimer {
+public:
+	PhaseTimer(FileStats& stats, Phase phase);
+	~PhaseTimer() { Stop(); }
+
+	PhaseTimer(const PhaseTimer&) = delete;
+	PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+	void Stop();
+
+private:
+	PhaseStats* target = nullptr;
+	Phase phase;
+	std::chrono::steady_clock::time_point start;
+	int64_t startBytes = 0;
+	int64_t outerPeakBytes = 0;
+	uint64_t startAllocations = 0;
+	uint64_t startArenaAllocations = 0;
+};
+
+// Collects the statistics of all files of a run for the end-of-run report.
+class RunStats {
+public:
+	void Clear() {
+		files.clear();
+		arenaPinnedBytes = 0;
+	}
+	void Add(const std::string& file, const FileStats& stats);
+	// Arena memory that stayed committed because allocations outlived their file
+	void SetArenaPinnedBytes(uint64_t bytes) { arenaPinnedBytes = bytes; }
+	size_t GetFileCount() const { return files.size(); }
+
+	// Per-phase totals and percentiles followed by the slowest files
+	std::string FormatReport(size_t slowestCount, const char* lineEnd = "\n") const;
+
+private:
+	std::vector<std::pair<std::string, FileStats>> files;
+	uint64_t arenaPinnedBytes = 0;
+};
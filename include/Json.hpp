@@ -0,0 +1,35 @@
+/*
+SSE NIF Optimizer
+See the included LICENSE file
+*/
+
+#pragma once
+
+#include <string>
+
+// Quoted and escaped JSON string. The input is expected to be UTF-8 and passed through as is.
+inline std::string QuoteJson(const std::string& str) {
+	constexpr char hex[] = "0123456789abcdef";
+
+	std::string out;
+	out.reserve(str.size() + 2);
+	out += '"';
+
+	for (unsigned char c : str) {
+		if (c == '"' || c == '\\') {
+			out += '\\';
+			out += static_cast<char>(c);
+		}
+		else if (c < 0x20) {
+			out += "\\u00";
+			out += hex[c >> 4];
+			out += hex[c & 0xF];
+		}
+		else {
+			out += static_cast<char>(c);
+		}
+	}
+
+	out += '"';
+	return out;
+}
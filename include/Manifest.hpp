@@ -0,0 +1,56 @@
+/*
+SSE NIF Optimizer
+See the included LICENSE file
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+struct ManifestEntry {
+	uint64_t size = 0;
+	int64_t modifiedTime = 0;
+	uint64_t contentHash = 0;
+	uint64_t optionsFingerprint = 0;
+	std::string toolVersion;
+};
+
+// Persistent record of optimized files, used by incremental runs to skip files
+// that haven't changed since they were last optimized with the same options.
+class Manifest {
+public:
+	bool Load(const std::string& fileName);
+	bool Save(const std::string& fileName) const;
+
+	size_t GetEntryCount() const { return entries.size(); }
+
+	// Copies the entry of a file, returns false if there is none
+	bool GetEntry(const std::string& file, ManifestEntry& outEntry) const;
+
+	// Returns true if the entry was recorded by this tool version with the same options and the file is
+	// unchanged. The file isn't opened if size and modification time still match. If only the modification
+	// time differs, the content hash decides. On a match, the new time is stored in the entry and refreshed
+	// is set.
+	// Works on a copy of the entry, so that files can be checked without holding a lock on the manifest.
+	static bool IsUpToDate(const std::string& file,
+						   ManifestEntry& entry,
+						   uint64_t optionsFingerprint,
+						   bool& refreshed);
+
+	// Stores the modification time of an entry that IsUpToDate refreshed, unless the file was recorded
+	// with other contents in the meantime
+	void RefreshModifiedTime(const std::string& file, const ManifestEntry& entry);
+
+	void Record(const std::string& file, uint64_t contentHash, uint64_t optionsFingerprint);
+	void Remove(const std::string& file);
+
+	static bool GetFileStatus(const std::string& file, uint64_t& size, int64_t& modifiedTime);
+	static bool HashFile(const std::string& file, uint64_t& contentHash);
+
+private:
+	std::unordered_map<std::string, ManifestEntry> entries;
+
+	static std::string GetKey(const std::string& file);
+};
@@ -0,0 +1,140 @@
+/*
+SSE NIF Optimizer
+See the included LICENSE file
+*/
+
+#pragma once
+
+#include <cstring>
+#include <streambuf>
+#include <vector>
+
+// Read-only stream buffer over memory owned by the caller. No data is copied.
+class MemoryInputBuf : public std::streambuf {
+public:
+	MemoryInputBuf(const char* data, size_t size) {
+		char* begin = const_cast<char*>(data);
+		setg(begin, begin, begin + size);
+	}
+
+protected:
+	pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override {
+		if (!(which & std::ios_base::in))
+			return pos_type(off_type(-1));
+
+		off_type base = 0;
+		if (dir == std::ios_base::cur)
+			base = gptr() - eback();
+		else if (dir == std::ios_base::end)
+			base = egptr() - eback();
+
+		return seekpos(pos_type(base + off), which);
+	}
+
+	pos_type seekpos(pos_type pos, std::ios_base::openmode which) override {
+		off_type off = off_type(pos);
+		if (!(which & std::ios_base::in) || off < 0 || off > egptr() - eback())
+			return pos_type(off_type(-1));
+
+		setg(eback(), eback() + off, egptr());
+		return pos;
+	}
+};
+
+// Write stream buffer that serializes into a growing vector.
+// Seeking back to overwrite already written data is supported.
+class MemoryOutputBuf : public std::streambuf {
+public:
+	explicit MemoryOutputBuf(std::vector<char>& buffer, size_t reserve = 0)
+		: buffer(buffer) {
+		buffer.clear();
+		buffer.resize(reserve > 0 ? reserve : 4096);
+		setp(buffer.data(), buffer.data() + buffer.size());
+	}
+
+	// Shrinks the vector to the written size. Call once writing is done.
+	void Finish() {
+		size_t size = UpdateSize();
+		buffer.resize(size);
+		setp(nullptr, nullptr);
+	}
+
+protected:
+	int_type overflow(int_type ch) override {
+		if (traits_type::eq_int_type(ch, traits_type::eof()))
+			return traits_type::not_eof(ch);
+
+		Grow(1);
+		*pptr() = traits_type::to_char_type(ch);
+		pbump(1);
+		return ch;
+	}
+
+	std::streamsize xsputn(const char* data, std::streamsize count) override {
+		if (epptr() - pptr() < count)
+			Grow(static_cast<size_t>(count));
+
+		std::memcpy(pptr(), data, static_cast<size_t>(count));
+		Advance(static_cast<size_t>(count));
+		return count;
+	}
+
+	pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override {
+		if (!(which & std::ios_base::out))
+			return pos_type(off_type(-1));
+
+		off_type base = 0;
+		if (dir == std::ios_base::cur)
+			base = pptr() - pbase();
+		else if (dir == std::ios_base::end)
+			base = static_cast<off_type>(UpdateSize());
+
+		return seekpos(pos_type(base + off), which);
+	}
+
+	pos_type seekpos(pos_type pos, std::ios_base::openmode which) override {
+		off_type off = off_type(pos);
+		if (!(which & std::ios_base::out) || off < 0 || off > static_cast<off_type>(UpdateSize()))
+			return pos_type(off_type(-1));
+
+		SetPosition(static_cast<size_t>(off));
+		return pos;
+	}
+
+private:
+	std::vector<char>& buffer;
+	size_t size = 0;
+
+	size_t UpdateSize() {
+		size_t pos = static_cast<size_t>(pptr() - pbase());
+		if (pos > size)
+			size = pos;
+		return size;
+	}
+
+	void SetPosition(size_t pos) {
+		setp(buffer.data(), buffer.data() + buffer.size());
+		Advance(pos);
+	}
+
+	// pbump only takes an int
+	void Advance(size_t count) {
+		while (count > 0) {
+			int n = count > 0x40000000 ? 0x40000000 : static_cast<int>(count);
+			pbump(n);
+			count -= static_cast<size_t>(n);
+		}
+	}
+
+	void Grow(size_t needed) {
+		size_t pos = static_cast<size_t>(pptr() - pbase());
+		UpdateSize();
+
+		size_t newSize = buffer.size() * 2;
+		if (newSize < pos + needed)
+			newSize = pos + needed;
+
+		buffer.resize(newSize);
+		SetPosition(pos);
+	}
+};
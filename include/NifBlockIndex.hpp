@@ -0,0 +1,53 @@
+/*
+SSE NIF Optimizer
+See the included LICENSE file
+*/
+
+#pragma once
+
+#include "NifFile.hpp"
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Name, parent and block ID lookups for the blocks of a NIF. NifFile scans all blocks for each of these,
+// which adds up when every bone of a heavily rigged file is looked up.
+// Built once per file. Nodes have to be added, deleted, moved and renamed through the index to keep it
+// up to date.
+class NifBlockIndex {
+public:
+	explicit NifBlockIndex(nifly::NifFile* nif);
+
+	// First block with the name, like NifFile::FindBlockByName
+	nifly::NiNode* FindNode(const std::string& name) const;
+	nifly::NiShape* FindShape(const std::string& name) const;
+
+	nifly::NiNode* GetParentNode(nifly::NiObject* block) const;
+	int GetBlockID(nifly::NiObject* block);
+
+	// Same as the NifFile functions of the same name
+	nifly::NiNode* AddNode(const std::string& name,
+						   const nifly::MatTransform& xformToParent,
+						   nifly::NiNode* parent = nullptr);
+	void DeleteNode(const std::string& name);
+	void SetParentNode(nifly::NiObject* block, nifly::NiNode* parent);
+
+	// Call after a node or shape was renamed
+	void UpdateName(nifly::NiObjectNET* block, const std::string& oldName);
+
+private:
+	nifly::NifFile* nif = nullptr;
+
+	// Blocks of each name in block order
+	std::unordered_map<std::string, std::vector<nifly::NiNode*>> nodes;
+	std::unordered_map<std::string, std::vector<nifly::NiShape*>> shapes;
+	std::unordered_map<const nifly::NiObject*, nifly::NiNode*> parents;
+
+	// Deleting a block moves the IDs of the blocks after it, so they are gathered again when needed
+	std::unordered_map<const nifly::NiObject*, int> blockIds;
+	bool blockIdsValid = false;
+
+	void AddName(nifly::NiObjectNET* block, const std::string& name);
+	void RemoveName(nifly::NiObjectNET* block, const std::string& name);
+};
@@ -0,0 +1,29 @@
+/*
+SSE NIF Optimizer
+See the included LICENSE file
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <vector>
+
+// Lightweight view of a NIF file header.
+// Only the header is parsed, none of the blocks, so reading it takes microseconds.
+class NifHeaderInfo {
+public:
+	uint32_t fileVersion = 0;
+	uint32_t userVersion = 0;
+	uint32_t streamVersion = 0;
+	uint32_t numBlocks = 0;
+	std::string exportInfo; // Creator and export strings joined by newlines
+	std::vector<std::string> blockTypes;
+
+	// Returns false if the stream doesn't start with a NIF header this parser understands.
+	bool Read(std::istream& stream);
+
+	bool HasBlockType(const std::string& blockType) const;
+	bool IsVersion(uint32_t file, uint32_t user, uint32_t stream) const;
+};
@@ -5,32 +5,19 @@ See the included LICENSE file
 
 #pragma once
 
+#include "OptimizerCore.hpp"
+#include "Trace.hpp"
+
 #include <wx/cmdline.h>
 #include <wx/dir.h>
 #include <wx/filepicker.h>
 #include <wx/spinctrl.h>
 #include <wx/wx.h>
 
-constexpr auto ProgramVersionLabel = "SSE NIF Optimizer v3.2.2";
-
-enum TargetGame { SSE, LE };
-
-struct OptimizerOptions {
-	wxArrayString files;
-	wxString folder;
-	bool recursive = true;
-	bool smoothNormals = false;
-	int smoothAngle = 60;
-	bool smoothSeamNormals = true;
-	bool headParts = false;
-	bool cleanSkinning = true;
-	bool calculateBounds = true;
-	bool removeParallax = true;
-	bool fixBSXFlags = true;
-	bool fixShaderFlags = true;
-	TargetGame targetGame = TargetGame::SSE;
-	wxString logFilePath;
-};
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <thread>
 
 struct ScanOptions {
 	wxString folder;
@@ -42,6 +29,9 @@ struct ScanOptions {
 
 class Optimizer;
 
+// Sent to the app by the worker thread when its task is done
+wxDECLARE_EVENT(EVT_WORKER_FINISHED, wxThreadEvent);
+
 class OptimizerApp : public wxApp {
 public:
 	virtual bool OnInit();
@@ -50,32 +40,78 @@ public:
 	virtual bool OnCmdLineParsed(wxCmdLineParser& parser);
 
 	void HandleCmdLine();
+
+	// Both run on the worker thread and return immediately
 	void Optimize(const OptimizerOptions& options);
 	void ScanTextures(const ScanOptions& options);
 
-	void Log(wxFile& file, const wxString& msg = "") {
-		if (file.IsOpened()) {
-			file.Write(msg);
-			file.Write("\r\n");
-			file.Flush();
-		}
-	}
+	bool IsWorkerRunning() const { return worker.joinable(); }
+
+	// Files that haven't been started yet are skipped, the worker stops within one file
+	void CancelWorker() { cancelRequested = true; }
+
+	// Cancels the worker and blocks until it's done. The finish handler isn't called.
+	void StopWorker();
+
+	// Closes the main window once the worker is done
+	void CloseWhenFinished() { closeWhenFinished = true; }
+
+	const wxString& GetTracePath() const { return cmdTracePath; }
+
+	void Log(AsyncLog& log, const wxString& msg = "") { log.WriteLine(msg.ToUTF8().data()); }
 
 private:
 	Optimizer* frame = nullptr;
 
+	std::thread worker;
+	std::atomic<bool> cancelRequested{false};
+	std::function<void()> workerFinished;
+	int lastWorkerId = 0;
+	bool closeWhenFinished = false;
+
+	// Runs the task on the worker thread, then the finish handler on the GUI thread
+	void RunWorker(std::function<void()> task, std::function<void()> finished);
+	void OnWorkerFinished(wxThreadEvent& event);
+
+	void ScanTextureFiles(const ScanOptions& options, wxArrayString& logResult);
+
 	wxString cmdOptimize;
 	wxString cmdLogPath;
+	wxString cmdJsonLogPath;
+	wxString cmdTracePath;
 	wxArrayString cmdPaths;
 	bool cmdRecursive = false;
 	bool cmdHeadparts = false;
+	long cmdJobs = 0;
+	bool cmdPipeline = false;
+	bool cmdForce = false;
+	bool cmdStats = false;
+	wxString cmdManifestPath;
 };
 
 static const wxCmdLineEntryDesc cmdLineDesc[]
 	= {{wxCMD_LINE_OPTION, "opt", "optimize", "Optimize for given target", wxCMD_LINE_VAL_STRING},
 	   {wxCMD_LINE_OPTION, "log", "log", "Path to log file", wxCMD_LINE_VAL_STRING},
+	   {wxCMD_LINE_OPTION, "jsonlog", "jsonlog", "Path to JSON Lines log file", wxCMD_LINE_VAL_STRING},
+	   {wxCMD_LINE_OPTION, "trace", "trace", "Path to Chrome trace event file", wxCMD_LINE_VAL_STRING},
 	   {wxCMD_LINE_SWITCH, "recursive", "recursive", "Recursively parse all directories"},
 	   {wxCMD_LINE_SWITCH, "headparts", "headparts", "Optimize files as headparts"},
+	   {wxCMD_LINE_OPTION,
+		"jobs",
+		"jobs",
+		"Number of worker threads (default: all cores)",
+		wxCMD_LINE_VAL_NUMBER},
+	   {wxCMD_LINE_SWITCH, "pipeline", "pipeline", "Read and write files in the background while optimizing"},
+	   {wxCMD_LINE_SWITCH,
+		"force",
+		"force",
+		"Also process files this version already optimized with the same options"},
+	   {wxCMD_LINE_SWITCH, "stats", "stats", "Add per-phase timings and the slowest files to the log"},
+	   {wxCMD_LINE_OPTION,
+		"manifest",
+		"manifest",
+		"Skip files that are unchanged since the last run with this manifest",
+		wxCMD_LINE_VAL_STRING},
 	   {wxCMD_LINE_PARAM,
 		"p",
 		"path",
@@ -87,9 +123,18 @@ static const wxCmdLineEntryDesc cmdLineDesc[]
 
 class Optimizer : public wxFrame {
 private:
+	// Interval in which progress posted by the worker is shown
+	static constexpr int ProgressRefreshMs = 100;
+
 	std::vector<std::pair<int, int>> progressStack;
 	int progressVal = 0;
 
+	wxTimer progressTimer;
+	std::mutex postedMutex;
+	bool progressPosted = false;
+	int postedProgress = 0;
+	wxString postedMessage;
+
 	wxStatusBar* statusBar = nullptr;
 	wxGauge* progressBar = nullptr;
 
@@ -107,6 +152,8 @@ private:
 	wxCheckBox* cbFixShaderFlags = nullptr;
 	wxCheckBox* cbMipmapsCheck = nullptr;
 	wxCheckBox* cbWriteLog = nullptr;
+	wxCheckBox* cbIncremental = nullptr;
+	wxCheckBox* cbForce = nullptr;
 	wxRadioButton* rbSSE = nullptr;
 	wxRadioButton* rbLE = nullptr;
 
@@ -115,6 +162,7 @@ private:
 	void cbSmoothNormalsChecked(wxCommandEvent& event);
 	void btOptimizeClicked(wxCommandEvent& event);
 	void btScanTexturesClicked(wxCommandEvent& event);
+	void progressTimerTick(wxTimerEvent& event);
 
 public:
 	bool isProcessing = false;
@@ -131,9 +179,14 @@ public:
 
 	void StartOptimize();
 	void EndOptimize();
+	void StartScanTextures();
+	void EndScanTextures();
 
 	void StartProgress(const wxString& msg = "");
 	void EndProgress(const wxString& msg = "");
 	void StartSubProgress(int min, int max);
 	void UpdateProgress(int val, const wxString& msg = "");
+
+	// Thread-safe. Only the latest progress is kept until the next refresh, no matter how often it's posted.
+	void PostProgress(int val, const wxString& msg = "");
 };
@@ -0,0 +1,163 @@
+/*
+SSE NIF Optimizer
+See the included LICENSE file
+*/
+
+#pragma once
+
+#include "AsyncLog.hpp"
+#include "FileCommitter.hpp"
+#include "Instrumentation.hpp"
+#include "NifFile.hpp"
+#include "NifHeaderInfo.hpp"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+constexpr auto ProgramVersionLabel = "SSE NIF Optimizer v3.2.2";
+
+enum TargetGame { SSE, LE };
+
+struct OptimizerOptions {
+	std::vector<std::string> files;   // UTF-8 paths
+	std::vector<std::string> folders; // Searched for files while the run is already processing them
+	bool recursive = true;
+	bool smoothNormals = false;
+	int smoothAngle = 60;
+	bool smoothSeamNormals = true;
+	bool headParts = false;
+	bool cleanSkinning = true;
+	std::string skeletonPath; // Reference skeleton for the standard bones of skinned shapes, optional
+	bool fastSkinBounds = false; // Approximate bone bounding spheres instead of finding the smallest ones
+	bool calculateBounds = true;
+	bool removeParallax = true;
+	bool fixBSXFlags = true;
+	bool fixShaderFlags = true;
+	TargetGame targetGame = TargetGame::SSE;
+	std::string logFilePath;
+	std::string jsonLogFilePath; // One JSON object per processed file (JSON Lines)
+	std::string traceFilePath;   // Chrome Trace Event Format file with spans for every file and phase
+	int jobs = 0; // 0 uses all cores
+	bool pipeline = false; // Overlap reading, optimizing and writing of files
+	bool memoryMap = true; // Map input files into memory instead of reading them with a stream
+	bool arenaAlloc = false; // Per-thread arena for each file's objects, needs the counting allocator
+	SyncPolicy syncPolicy = SyncPolicy::None; // Flushing of saved files to the disk
+	size_t syncBatchSize = 64;
+	std::string manifestPath; // Incremental mode: skip files recorded as unchanged in this manifest
+	bool skipOptimized = true; // Skip files at the target version this version optimized with these options
+	bool reportStats = false; // Add per-phase timings and the slowest files to the end of the log
+	size_t slowestFiles = 10;
+};
+
+enum class FileStatus { Cancelled, LoadFailed, SaveFailed, Saved, Identical, Unchanged, AlreadyOptimized };
+constexpr size_t FileStatusCount = 7;
+
+struct FileResult {
+	FileStatus status = FileStatus::Cancelled;
+	bool skinned = false;
+	nifly::OptResult optResult;
+	uint64_t contentHash = 0; // Hash of the optimized file contents
+	// Set on a second report of a file that was reported as Saved, but whose batch couldn't replace the
+	// original later on. The status is SaveFailed then and the log only has this report.
+	bool replaceFailed = false;
+	FileStats stats;
+};
+
+// Progress of a run, weighted by file size so that a few big files don't throw off the estimate
+struct RunProgress {
+	size_t filesDone = 0;
+	size_t fileCount = 0; // Grows while the folders are still being searched
+	uint64_t bytesDone = 0;
+	uint64_t totalBytes = 0;
+	bool searchFinished = false;
+	double elapsedSeconds = 0.0;
+
+	double GetPercent() const;
+
+	// Estimated from the throughput so far, negative while unknown
+	double GetSecondsLeft() const;
+
+	// "12.3 / 45.6 MB, about 1:23 left"
+	std::string GetStatusText() const;
+};
+
+// GUI-free optimizer. Front ends fill in the options and follow the run through the callbacks.
+class OptimizerCore {
+public:
+	// Called on the thread running Optimize for every finished file, in the order they finish.
+	// The largest files are started first. With batched syncing, a saved file is only replaced once its
+	// batch is committed. If that fails, the file is reported once more with replaceFailed set.
+	// The log and the JSON Lines output list the files sorted by path once all of them are done.
+	std::function<void(const RunProgress& progress, const std::string& file, const FileResult& result)>
+		progressCallback;
+
+	// Called regularly on the thread running Optimize while it waits for the workers and after every file.
+	// Returning false cancels the remaining files, the ones already started are finished.
+	std::function<bool()> idleCallback;
+
+	void Optimize(const OptimizerOptions& options);
+
+	// Statistics of all files processed by the last run
+	const RunStats& GetRunStats() const { return runStats; }
+
+	// Adds all optimizable files (nif, btr, bto) in the folder to the list.
+	static void FindFiles(const std::string& folder, bool recursive, std::vector<std::string>& files);
+	static bool IsOptimizableFile(const std::string& file);
+
+	// Optimizes a single file. Safe to call from any thread.
+	// The file is replaced through the committer if there is one, otherwise right away.
+	static FileResult OptimizeFile(const std::string& file,
+								   const OptimizerOptions& options,
+								   FileCommitter* committer = nullptr);
+
+	// Optimizes a file that was read into memory and serializes the result to outData.
+	// The status is Identical instead of Saved if the result matches the input byte for byte.
+	// Safe to call from any thread.
+	static FileResult OptimizeBuffer(const std::vector<char>& inData,
+									 std::vector<char>& outData,
+									 const nifly::NifLoadOptions& loadOptions,
+									 const OptimizerOptions& options);
+	static FileResult OptimizeBuffer(const char* inData,
+									 size_t inSize,
+									 std::vector<char>& outData,
+									 const nifly::NifLoadOptions& loadOptions,
+									 const OptimizerOptions& options);
+
+	static nifly::NifLoadOptions GetLoadOptions(const std::string& file);
+
+	// Hash of all options that affect the optimized output
+	static uint64_t GetOptionsFingerprint(const OptimizerOptions& options);
+
+	static nifly::NiVersion GetTargetVersion(TargetGame targetGame);
+
+	// Decides from the header alone whether the full load/optimize/save path is needed.
+	// Files at the target version that were already optimized by this version of the tool with the same
+	// options (see GetOptionsFingerprint) are left alone, unless one of the extras (smooth normals) is
+	// requested.
+	static bool NeedsOptimization(const NifHeaderInfo& header, const OptimizerOptions& options);
+
+	static const char* GetStatusName(FileStatus status);
+
+	// Single-line JSON object with the status and all optimization results of a file
+	static std::string GetJsonResult(const std::string& file, const FileResult& result);
+
+private:
+	AsyncLog logFile;
+	AsyncLog jsonLog;
+	RunStats runStats;
+
+	void Log(const std::string& msg = "");
+	void LogFileResult(const std::string& file, const FileResult& result);
+
+	static FileResult ProcessBuffer(const char* inData,
+									size_t inSize,
+									std::vector<char>& outData,
+									const nifly::NifLoadOptions& loadOptions,
+									const OptimizerOptions& options);
+	static void OptimizeNif(nifly::NifFile& nif, const OptimizerOptions& options, FileResult& result);
+
+	// Runs an empty file through outside of any arena, so that the lookup tables nifly creates on first use
+	// don't pin the arena of the first real file
+	static void PrimeStatics(const OptimizerOptions& options);
+};
@@ -0,0 +1,74 @@
+/*
+SSE NIF Optimizer
+See the included LICENSE file
+*/
+
+#pragma once
+
+#include "BoundedQueue.hpp"
+#include "FileScheduler.hpp"
+#include "OptimizerCore.hpp"
+#include "ThreadPool.hpp"
+
+#include <atomic>
+#include <functional>
+#include <future>
+#include <thread>
+
+// Three-stage read -> optimize -> write pipeline.
+// A prefetch thread reads upcoming files into memory, the pool workers optimize them
+// and a write-behind thread flushes the saved files to disk. Bounded queues between
+// the stages cap the amount of memory held by files in flight.
+// Files can be added while earlier ones are already being processed.
+class OptimizerPipeline {
+public:
+	// Memory limit for each of the two queues
+	static constexpr size_t QueueBytes = 256 * 1024 * 1024;
+
+	// Called on a pipeline thread for every file, also for failed and cancelled ones
+	using FinishedCallback = std::function<void(const FileScheduler::Entry& entry, FileResult result)>;
+
+	OptimizerPipeline(const OptimizerOptions& options,
+					  ThreadPool& pool,
+					  std::atomic<bool>& cancelled,
+					  FileCommitter& committer,
+					  FinishedCallback onFinished);
+	~OptimizerPipeline();
+
+	// Queues a file for processing. Thread-safe, the largest waiting file is read first.
+	void Add(const std::string& file, uint64_t fileSize);
+
+	// Signals that no more files will be added. Called by the destructor if needed.
+	void Finish();
+
+private:
+	struct ReadItem {
+		FileScheduler::Entry entry;
+		std::vector<char> data;
+		PhaseStats readStats;
+	};
+
+	struct WriteItem {
+		FileScheduler::Entry entry;
+		std::vector<char> data;
+		FileResult result;
+	};
+
+	const OptimizerOptions& options;
+	std::atomic<bool>& cancelled;
+	FileCommitter& committer;
+	FinishedCallback onFinished;
+
+	FileScheduler inputQueue;
+	BoundedQueue<ReadItem> readQueue;
+	BoundedQueue<WriteItem> writeQueue;
+
+	std::thread reader;
+	std::thread writer;
+	std::vector<std::future<void>> workers;
+	std::atomic<size_t> workersRunning{0};
+
+	void ReadLoop();
+	void OptimizeLoop();
+	void WriteLoop();
+};
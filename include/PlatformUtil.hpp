@@ -11,6 +11,7 @@ See the included LICENSE file
 
 #include <fstream>
 #include <string>
+#include <vector>
 
 namespace PlatformUtil {
 #ifdef _WINDOWS
@@ -27,4 +28,27 @@ void OpenFileStream(std::fstream& file, const std::string& fileName, unsigned in
 #ifdef _WINDOWS
 void OpenFileStream(std::fstream& file, const std::wstring& fileName, unsigned int mode);
 #endif
+
+// Reads the whole file into memory
+bool ReadFile(const std::string& fileName, std::vector<char>& data);
+
+// Replaces the file contents with the given data
+bool WriteFile(const std::string& fileName, const char* data, size_t size);
+
+// Creates or truncates the file and writes the data with as few calls as possible.
+// With sync, the data is flushed to the disk before returning.
+bool WriteNewFile(const std::string& fileName, const char* data, size_t size, bool sync = false);
+
+// Unique name for a temporary file in the same folder as the file
+std::string GetTempFileName(const std::string& fileName);
+
+// Flushes the contents of a closed file to the disk
+bool SyncFile(const std::string& fileName);
+
+// Flushes renames in the folder to the disk. Does nothing on Windows, where renames are written through.
+bool SyncDirectory(const std::string& folder);
+
+// Atomically replaces the target with the source file.
+// With sync, the rename is flushed to the disk before returning.
+bool RenameFile(const std::string& source, const std::string& target, bool sync = false);
 } // namespace PlatformUtil
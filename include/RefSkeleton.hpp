@@ -0,0 +1,66 @@
+/*
+SSE NIF Optimizer
+See the included LICENSE file
+*/
+
+#pragma once
+
+#include "NifFile.hpp"
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Bone hierarchy of a reference skeleton NIF. Immutable once loaded, so one instance is shared
+// read-only by all worker threads.
+// Bones are stored flat with parent indices, a parent always comes before its children.
+class RefSkeleton {
+public:
+	struct Bone {
+		std::string name;
+		int parent = -1;
+		nifly::MatTransform xformToParent;
+		nifly::MatTransform xformToGlobal;
+	};
+
+	// Loads every skeleton only once per process, later calls return the same instance until the
+	// skeleton file changes. Returns nullptr if the skeleton can't be loaded. Thread-safe.
+	static std::shared_ptr<const RefSkeleton> Get(const std::string& fileName,
+												  const std::string& cacheFileName = std::string());
+
+	// Uses the binary cache if it's given and up to date, otherwise the NIF is parsed and the cache is
+	// written for the next time
+	static std::shared_ptr<const RefSkeleton> Load(const std::string& fileName,
+												   const std::string& cacheFileName = std::string());
+
+	static std::shared_ptr<const RefSkeleton> LoadFromNif(const std::string& fileName);
+
+	// Cache of the skeleton beside a manifest, the skeleton's own folder is usually the game's or a mod's
+	static std::string GetCacheFileName(const std::string& fileName, const std::string& manifestPath);
+
+	const std::vector<Bone>& GetBones() const { return bones; }
+	const Bone* GetRootBone() const { return bones.empty() ? nullptr : &bones.front(); }
+
+	// Returns -1 if there is no bone with that name
+	int FindBone(const std::string& name) const;
+
+	bool IsFromCache() const { return fromCache; }
+
+	// Hash of the skeleton file contents
+	uint64_t GetSourceHash() const { return sourceHash; }
+
+private:
+	std::vector<Bone> bones;
+	std::unordered_map<std::string, int> boneIndices;
+	uint64_t sourceSize = 0;
+	int64_t sourceTime = 0;
+	uint64_t sourceHash = 0;
+	bool fromCache = false;
+
+	bool AddBone(const std::string& name, int parent, const nifly::MatTransform& xformToParent);
+
+	// The source size and time have to be set already
+	bool LoadCache(const std::string& cacheFileName);
+	bool SaveCache(const std::string& cacheFileName) const;
+};
@@ -0,0 +1,113 @@
+/*
+SSE NIF Optimizer
+See the included LICENSE file
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Strongest influences of a vertex, sorted by weight in descending order. Fixed size, so that the
+// influences of a whole shape fit in one flat array without allocations per vertex.
+struct VertexInfluences {
+	static constexpr int MaxCount = 4; // Influences per vertex the game supports
+
+	float weights[MaxCount] = {};
+	uint8_t bones[MaxCount] = {};
+	int count = 0;
+
+	// Zero weights are ignored. Once full, the weakest influence is dropped, of equal weights the one
+	// added first goes.
+	void Add(uint8_t bone, float weight) {
+		if (weight == 0.0f || (count == MaxCount && weight < weights[MaxCount - 1]))
+			return;
+
+		int i = count < MaxCount ? count : MaxCount - 1;
+		for (; i > 0 && weights[i - 1] <= weight; i--) {
+			weights[i] = weights[i - 1];
+			bones[i] = bones[i - 1];
+		}
+
+		weights[i] = weight;
+		bones[i] = bone;
+		count += count < MaxCount;
+	}
+
+	// Scales the weights to add up to one, after weaker influences have been dropped
+	void Normalize() {
+		float sum = 0.0f;
+		for (int i = 0; i < count; i++)
+			sum += weights[i];
+
+		if (sum <= 0.0f)
+			return;
+
+		for (int i = 0; i < count; i++)
+			weights[i] /= sum;
+	}
+};
+
+// Bone x vertex weight matrix of a skinned shape in compressed sparse row form.
+// The influences of a bone are stored together and sorted by vertex. All bones share the same arrays,
+// so a whole shape needs three allocations instead of a hash node per influence.
+class SkinWeights {
+public:
+	// Influences of one bone, valid until the matrix is changed
+	struct BoneRow {
+		const uint16_t* vertices = nullptr;
+		const float* weights = nullptr;
+		size_t size = 0;
+	};
+
+	void Clear();
+
+	size_t GetBoneCount() const { return rowStart.size() - 1; }
+	size_t GetInfluenceCount() const { return vertices.size(); }
+
+	// Bones past the end have no influences
+	BoneRow GetBone(size_t bone) const;
+	void GetBone(size_t bone, std::unordered_map<uint16_t, float>& outWeights) const;
+
+	// True if the bone has at least one positive weight
+	bool HasInfluence(size_t bone) const;
+
+	// Highest referenced vertex plus one
+	size_t GetVertexEnd() const;
+
+	// Builds the matrix from up to slotCount influences per vertex, as they are stored in vertex data.
+	// The pointers are to the first slot of the first vertex, stride is the distance between vertices
+	// in bytes. Zero weights, bones from boneCount on and repeats of a bone within a vertex are skipped.
+	void SetFromVertices(size_t boneCount,
+						 size_t vertexCount,
+						 size_t slotCount,
+						 const uint8_t* slotBones,
+						 const float* slotWeights,
+						 size_t stride);
+
+	// Appends a row for the next bone
+	void AddBone(const std::unordered_map<uint16_t, float>& boneWeights);
+
+	// Replaces the weights of a bone, adding empty rows up to it if needed
+	void SetBone(size_t bone, const std::unordered_map<uint16_t, float>& boneWeights);
+
+	// Removes the row of a bone, the bones after it move down by one
+	void RemoveBone(size_t bone);
+
+	// Removes many bones in one pass. boneMap has the new index of every bone, or -1 to remove it.
+	// New indices have to keep the order of the bones.
+	void RemapBones(const std::vector<int>& boneMap);
+
+	// Same mapping as ApplyIndexMapToMapKeys: vertices covered by indexMap are mapped and dropped if
+	// they map to -1, the ones after it are moved by mapEndOffset.
+	void RemapVertices(const std::vector<int>& indexMap, int mapEndOffset);
+
+private:
+	std::vector<uint32_t> rowStart{0}; // Offsets of the rows into vertices and weights, one more than bones
+	std::vector<uint16_t> vertices;
+	std::vector<float> weights;
+
+	void SortRange(uint32_t start, uint32_t end);
+};
@@ -0,0 +1,63 @@
+/*
+SSE NIF Optimizer
+See the included LICENSE file
+*/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing thread pool.
+// Every worker owns a task queue and takes work from its front.
+// Workers that run out of work steal from the back of the other queues.
+class ThreadPool {
+public:
+	// A thread count of 0 uses all hardware threads.
+	explicit ThreadPool(size_t threadCount = 0);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	size_t GetThreadCount() const { return workers.size(); }
+
+	template<typename Func>
+	auto Submit(Func&& func) -> std::future<decltype(func())> {
+		using Result = decltype(func());
+		auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<Func>(func));
+		std::future<Result> future = task->get_future();
+		Push([task]() { (*task)(); });
+		return future;
+	}
+
+	// Returns the index of the calling worker thread or -1 if called from outside of a pool.
+	static int GetWorkerIndex();
+
+private:
+	struct WorkQueue {
+		std::mutex mutex;
+		std::deque<std::function<void()>> tasks;
+	};
+
+	std::vector<std::unique_ptr<WorkQueue>> queues;
+	std::vector<std::thread> workers;
+
+	std::mutex wakeMutex;
+	std::condition_variable wakeCondition;
+	std::atomic<size_t> pendingCount{0};
+	std::atomic<size_t> nextQueue{0};
+	bool stopping = false;
+
+	void Push(std::function<void()> task);
+	bool Pop(size_t index, std::function<void()>& task);
+	bool Steal(size_t index, std::function<void()>& task);
+	void WorkerLoop(size_t index);
+};
@@ -0,0 +1,55 @@
+/*
+SSE NIF Optimizer
+See the included LICENSE file
+*/
+
+#pragma once
+
+#include <chrono>
+#include <string>
+
+// Records spans in the Chrome Trace Event Format, for chrome://tracing or Perfetto.
+// Every thread appends to its own buffer, so recording doesn't contend between workers.
+// All functions are cheap no-ops while no trace is being recorded.
+class Trace {
+public:
+	using Clock = std::chrono::steady_clock;
+
+	// Discards previous events and starts recording
+	static void Start();
+
+	// Stops recording and writes all events to a JSON file
+	static bool Stop(const std::string& fileName);
+
+	static bool IsEnabled();
+
+	// Name shown for the calling thread in the viewer. Pool workers are named automatically.
+	static void SetThreadName(const std::string& name);
+
+	// Adds a complete span on the calling thread
+	static void AddSpan(const char* name, const char* category, Clock::time_point start, Clock::time_point end);
+
+	// Adds a span for a file, named after the file with the full path in its arguments
+	static void AddFileSpan(const std::string& path, Clock::time_point start, Clock::time_point end);
+};
+
+// Records a span on the calling thread from construction until destruction.
+class TraceSpan {
+public:
+	TraceSpan(const char* name, const char* category);
+
+	// Span covering the processing of a file
+	explicit TraceSpan(const std::string& path);
+
+	~TraceSpan();
+
+	TraceSpan(const TraceSpan&) = delete;
+	TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+	bool enabled = false;
+	const char* name = nullptr;
+	const char* category = nullptr;
+	std::string path;
+	Trace::Clock::time_point start;
+};
@@ -0,0 +1,91 @@
+/*
+SSE NIF Optimizer
+See the included LICENSE file
+*/
+
+#pragma once
+
+#include "NifFile.hpp"
+
+#include <vector>
+
+// Transforms in structure of arrays form, so that the batch functions can work on several of them at once.
+// Every stream is padded to a multiple of the widest kernel, the kernels never need a scalar tail.
+class TransformArray {
+public:
+	// Rotation row by row in streams 0 to 8, translation in 9 to 11, scale in 12
+	static constexpr size_t StreamCount = 13;
+	static constexpr size_t Padding = 8;
+
+	TransformArray() = default;
+	explicit TransformArray(size_t count) { Resize(count); }
+
+	// Keeps the transforms that fit, new ones are identities
+	void Resize(size_t count);
+	size_t GetSize() const { return size; }
+	size_t GetStride() const { return stride; }
+
+	void Set(size_t index, const nifly::MatTransform& xform);
+	nifly::MatTransform Get(size_t index) const;
+
+	float* GetStream(size_t stream) { return data.data() + stream * stride; }
+	const float* GetStream(size_t stream) const { return data.data() + stream * stride; }
+
+private:
+	std::vector<float> data;
+	size_t size = 0;
+	size_t stride = 0;
+};
+
+// Vectors in structure of arrays form, padded like TransformArray
+class VectorArray {
+public:
+	static constexpr size_t StreamCount = 3;
+
+	VectorArray() = default;
+	explicit VectorArray(size_t count) { Resize(count); }
+
+	// Keeps the vectors that fit, new ones are zero
+	void Resize(size_t count);
+	size_t GetSize() const { return size; }
+	size_t GetStride() const { return stride; }
+
+	void Set(size_t index, const nifly::Vector3& vec);
+	nifly::Vector3 Get(size_t index) const;
+
+	float* GetStream(size_t stream) { return data.data() + stream * stride; }
+	const float* GetStream(size_t stream) const { return data.data() + stream * stride; }
+
+private:
+	std::vector<float> data;
+	size_t size = 0;
+	size_t stride = 0;
+};
+
+enum class TransformKernel { Scalar, SSE2, AVX2 };
+
+// Same math as the MatTransform functions of the same names, element by element. The inputs have to be
+// of the same size, the output is resized to them and may be one of the inputs.
+namespace TransformBatch {
+// Best kernel the CPU and the build support, AVX2 is checked for at runtime
+TransformKernel GetBestKernel();
+bool IsSupported(TransformKernel kernel);
+const char* GetKernelName(TransformKernel kernel);
+
+// out[i] = a[i].ComposeTransforms(b[i])
+void ComposeTransforms(const TransformArray& a,
+					   const TransformArray& b,
+					   TransformArray& out,
+					   TransformKernel kernel = GetBestKernel());
+
+// out[i] = xforms[i].InverseTransform()
+void InverseTransforms(const TransformArray& xforms,
+					   TransformArray& out,
+					   TransformKernel kernel = GetBestKernel());
+
+// out[i] = xforms[i].ApplyTransform(vecs[i])
+void ApplyTransforms(const TransformArray& xforms,
+					 const VectorArray& vecs,
+					 VectorArray& out,
+					 TransformKernel kernel = GetBestKernel());
+} // namespace TransformBatch
@@ -0,0 +1,137 @@
+/*
+SSE NIF Optimizer
+See the included LICENSE file
+*/
+
+#pragma once
+
+#include <cstddef>
+
+// Kernels of TransformBatch, written once for any lane type. A lane type holds Width floats and provides
+// Load, Set, Store and the arithmetic operators. Only included by the TransformBatch translation units,
+// each instantiates the kernels for the instruction set it's built with.
+// The kernels work on the stream pointers of TransformArray and VectorArray rather than the classes, so
+// that no inline function shared with the rest of the program gets compiled with AVX2.
+namespace TransformKernels {
+constexpr size_t TransformStreamCount = 13;
+constexpr size_t VectorStreamCount = 3;
+
+struct KernelTable {
+	void (*compose)(const float* const* a, const float* const* b, float* const* out, size_t stride);
+	void (*inverse)(const float* const* xforms, float* const* out, size_t stride);
+	void (*apply)(const float* const* xforms, const float* const* vecs, float* const* out, size_t stride);
+};
+
+// Returns nullptr if the compiler couldn't build the AVX2 kernels
+const KernelTable* GetAvx2Kernels();
+
+struct ScalarLane {
+	static constexpr size_t Width = 1;
+	float v;
+
+	static ScalarLane Load(const float* p) { return {*p}; }
+	static ScalarLane Set(float f) { return {f}; }
+	void Store(float* p) const { *p = v; }
+
+	friend ScalarLane operator+(ScalarLane a, ScalarLane b) { return {a.v + b.v}; }
+	friend ScalarLane operator-(ScalarLane a, ScalarLane b) { return {a.v - b.v}; }
+	friend ScalarLane operator*(ScalarLane a, ScalarLane b) { return {a.v * b.v}; }
+	friend ScalarLane operator/(ScalarLane a, ScalarLane b) { return {a.v / b.v}; }
+};
+
+// Every stream has stride floats, a multiple of the lane width. All of an element is loaded before
+// anything is stored, so the output may be one of the inputs.
+template<typename Lane>
+void Compose(const float* const* aStreams,
+			 const float* const* bStreams,
+			 float* const* outStreams,
+			 size_t stride) {
+	for (size_t i = 0; i < stride; i += Lane::Width) {
+		Lane ar[9], br[9], at[3], bt[3];
+		for (size_t e = 0; e < 9; e++) {
+			ar[e] = Lane::Load(aStreams[e] + i);
+			br[e] = Lane::Load(bStreams[e] + i);
+		}
+
+		for (size_t e = 0; e < 3; e++) {
+			at[e] = Lane::Load(aStreams[9 + e] + i);
+			bt[e] = Lane::Load(bStreams[9 + e] + i);
+		}
+
+		Lane as = Lane::Load(aStreams[12] + i);
+		Lane bs = Lane::Load(bStreams[12] + i);
+
+		// translation + rotation * other.translation * scale, rotation * other.rotation, scale * other.scale
+		for (size_t r = 0; r < 3; r++) {
+			for (size_t c = 0; c < 3; c++)
+				(ar[r * 3] * br[c] + ar[r * 3 + 1] * br[3 + c] + ar[r * 3 + 2] * br[6 + c])
+					.Store(outStreams[r * 3 + c] + i);
+
+			(at[r] + (ar[r * 3] * bt[0] + ar[r * 3 + 1] * bt[1] + ar[r * 3 + 2] * bt[2]) * as)
+				.Store(outStreams[9 + r] + i);
+		}
+
+		(as * bs).Store(outStreams[12] + i);
+	}
+}
+
+template<typename Lane>
+void Inverse(const float* const* inStreams, float* const* outStreams, size_t stride) {
+	const Lane one = Lane::Set(1.0f);
+	const Lane zero = Lane::Set(0.0f);
+
+	for (size_t i = 0; i < stride; i += Lane::Width) {
+		Lane r[9], t[3];
+		for (size_t e = 0; e < 9; e++)
+			r[e] = Lane::Load(inStreams[e] + i);
+		for (size_t e = 0; e < 3; e++)
+			t[e] = Lane::Load(inStreams[9 + e] + i);
+
+		Lane invScale = one / Lane::Load(inStreams[12] + i);
+		Lane negScale = zero - invScale;
+
+		// Transposed rotation, inverse rotation * translation * -inverse scale, 1 / scale
+		for (size_t row = 0; row < 3; row++) {
+			for (size_t c = 0; c < 3; c++)
+				r[c * 3 + row].Store(outStreams[row * 3 + c] + i);
+
+			((r[row] * t[0] + r[3 + row] * t[1] + r[6 + row] * t[2]) * negScale)
+				.Store(outStreams[9 + row] + i);
+		}
+
+		invScale.Store(outStreams[12] + i);
+	}
+}
+
+template<typename Lane>
+void Apply(const float* const* xformStreams,
+		   const float* const* vecStreams,
+		   float* const* outStreams,
+		   size_t stride) {
+	for (size_t i = 0; i < stride; i += Lane::Width) {
+		Lane v[3];
+		for (size_t e = 0; e < 3; e++)
+			v[e] = Lane::Load(vecStreams[e] + i);
+
+		Lane scale = Lane::Load(xformStreams[12] + i);
+
+		// translation + rotation * vector * scale
+		Lane result[3];
+		for (size_t row = 0; row < 3; row++) {
+			Lane rotated = Lane::Load(xformStreams[row * 3] + i) * v[0]
+						   + Lane::Load(xformStreams[row * 3 + 1] + i) * v[1]
+						   + Lane::Load(xformStreams[row * 3 + 2] + i) * v[2];
+			result[row] = Lane::Load(xformStreams[9 + row] + i) + rotated * scale;
+		}
+
+		for (size_t e = 0; e < 3; e++)
+			result[e].Store(outStreams[e] + i);
+	}
+}
+
+template<typename Lane>
+const KernelTable& GetKernels() {
+	static const KernelTable table = {&Compose<Lane>, &Inverse<Lane>, &Apply<Lane>};
+	return table;
+}
+} // namespace TransformKernels
@@ -4,13 +4,98 @@ See the included LICENSE file
 */
 
 #include "Anim.hpp"
+#include "Arena.hpp"
+#include "NifBlockIndex.hpp"
 #include "NifUtil.hpp"
+#include "TransformBatch.hpp"
 
-#include <sstream>
+#include <algorithm>
+#include <cmath>
+#include <iterator>
 #include <unordered_set>
 
 using namespace nifly;
 
+namespace {
+// Ritter's sphere: starts with the most distant pair of the extreme points along the axes, then grows to
+// take in every point that is still outside.
+BoundingSphere CalcApproxBoundingSphere(const std::vector<Vector3>& verts, const SkinWeights::BoneRow& row) {
+	BoundingSphere sphere;
+	if (row.size == 0)
+		return sphere;
+
+	const Vector3* minPoints[3];
+	const Vector3* maxPoints[3];
+	for (int axis = 0; axis < 3; axis++)
+		minPoints[axis] = maxPoints[axis] = &verts[row.vertices[0]];
+
+	auto coord = [](const Vector3& v, int axis) { return axis == 0 ? v.x : (axis == 1 ? v.y : v.z); };
+
+	for (size_t i = 1; i < row.size; i++) {
+		const Vector3& v = verts[row.vertices[i]];
+		for (int axis = 0; axis < 3; axis++) {
+			if (coord(v, axis) < coord(*minPoints[axis], axis))
+				minPoints[axis] = &v;
+			if (coord(v, axis) > coord(*maxPoints[axis], axis))
+				maxPoints[axis] = &v;
+		}
+	}
+
+	int widest = 0;
+	float widestDist = -1.0f;
+	for (int axis = 0; axis < 3; axis++) {
+		float dist = minPoints[axis]->DistanceSquaredTo(*maxPoints[axis]);
+		if (dist > widestDist) {
+			widestDist = dist;
+			widest = axis;
+		}
+	}
+
+	sphere.center = (*minPoints[widest] + *maxPoints[widest]) * 0.5f;
+	sphere.radius = std::sqrt(widestDist) * 0.5f;
+
+	for (size_t i = 0; i < row.size; i++) {
+		const Vector3& v = verts[row.vertices[i]];
+		float dist = sphere.center.DistanceTo(v);
+		if (dist <= sphere.radius)
+			continue;
+
+		// Moves the near side of the sphere just enough to reach the point
+		float radius = (sphere.radius + dist) * 0.5f;
+		sphere.center = sphere.center + (v - sphere.center) * ((radius - sphere.radius) / dist);
+		sphere.radius = radius;
+	}
+
+	return sphere;
+}
+
+// Bounds of a bone in skin space. Returns false if the bone has weights for vertices past verts.
+bool CalcBoneBounds(const std::vector<Vector3>& verts,
+					const SkinWeights::BoneRow& row,
+					SkinBoundsMode mode,
+					std::vector<Vector3>& points,
+					BoundingSphere& outBounds) {
+	// Incoming weights may cover more verts than the shape has. Rows are sorted, so check the last one.
+	if (row.size > 0 && row.vertices[row.size - 1] >= verts.size())
+		return false;
+
+	BoundingSphere bounds;
+	if (mode == SkinBoundsMode::Approximate) {
+		bounds = CalcApproxBoundingSphere(verts, row);
+	}
+	else {
+		points.clear();
+		for (size_t i = 0; i < row.size; i++)
+			points.push_back(verts[row.vertices[i]]);
+
+		bounds = BoundingSphere(points);
+	}
+
+	outBounds = bounds;
+	return true;
+}
+} // namespace
+
 bool AnimInfo::AddShapeBone(const std::string& shape, const std::string& boneName) {
 	for (auto& bone : shapeBones[shape])
 		if (!bone.compare(boneName))
@@ -31,10 +116,12 @@ bool AnimInfo::RemoveShapeBone(const std::string& shape, const std::string& bone
 	bones.erase(std::remove(bones.begin(), bones.end(), boneName), bones.end());
 	shapeSkinning[shape].RemoveBone(boneName);
 
-	AnimSkeleton::getInstance().ReleaseBone(boneName);
+	AnimSkeleton& skeleton = AnimSkeleton::getInstance();
+	int boneId = skeleton.GetBoneId(boneName);
+	skeleton.ReleaseBone(boneId);
 
 	if (refNif && refNif->IsValid()) {
-		if (AnimSkeleton::getInstance().GetBoneRefCount(boneName) <= 0) {
+		if (skeleton.GetBoneRefCount(boneId) <= 0) {
 			if (refNif->CanDeleteNode(boneName))
 				refNif->DeleteNode(boneName);
 		}
@@ -43,13 +130,50 @@ bool AnimInfo::RemoveShapeBone(const std::string& shape, const std::string& bone
 	return true;
 }
 
+int AnimInfo::RemoveShapeBones(const std::string& shape, const std::vector<std::string>& boneNames) {
+	if (boneNames.empty())
+		return 0;
+
+	std::unordered_set<std::string> removeNames(boneNames.begin(), boneNames.end());
+	auto& bones = shapeBones[shape];
+
+	auto kept = std::stable_partition(bones.begin(), bones.end(), [&](const std::string& bone) {
+		return removeNames.count(bone) == 0;
+	});
+
+	std::vector<std::string> removed(std::make_move_iterator(kept), std::make_move_iterator(bones.end()));
+	bones.erase(kept, bones.end());
+	if (removed.empty())
+		return 0;
+
+	shapeSkinning[shape].RemoveBones(boneNames);
+
+	AnimSkeleton& skeleton = AnimSkeleton::getInstance();
+	for (auto& boneName : removed) {
+		int boneId = skeleton.GetBoneId(boneName);
+		skeleton.ReleaseBone(boneId);
+
+		if (refNif && refNif->IsValid()) {
+			if (skeleton.GetBoneRefCount(boneId) <= 0) {
+				if (refNif->CanDeleteNode(boneName))
+					refNif->DeleteNode(boneName);
+			}
+		}
+	}
+
+	return static_cast<int>(removed.size());
+}
+
 void AnimInfo::Clear() {
+	AnimSkeleton& skeleton = AnimSkeleton::getInstance();
+
 	if (refNif && refNif->IsValid()) {
 		for (auto& shapeBoneList : shapeBones) {
 			for (auto& boneName : shapeBoneList.second) {
-				AnimSkeleton::getInstance().ReleaseBone(boneName);
+				int boneId = skeleton.GetBoneId(boneName);
+				skeleton.ReleaseBone(boneId);
 
-				if (AnimSkeleton::getInstance().GetBoneRefCount(boneName) <= 0) {
+				if (skeleton.GetBoneRefCount(boneId) <= 0) {
 					if (refNif->CanDeleteNode(boneName))
 						refNif->DeleteNode(boneName);
 				}
@@ -65,7 +189,7 @@ void AnimInfo::Clear() {
 	else {
 		for (auto& shapeBoneList : shapeBones)
 			for (auto& boneName : shapeBoneList.second)
-				AnimSkeleton::getInstance().ReleaseBone(boneName);
+				skeleton.ReleaseBone(boneName);
 
 		shapeSkinning.clear();
 		shapeBones.clear();
@@ -76,11 +200,14 @@ void AnimInfo::ClearShape(const std::string& shape) {
 	if (shape.empty())
 		return;
 
+	AnimSkeleton& skeleton = AnimSkeleton::getInstance();
+
 	for (auto& boneName : shapeBones[shape]) {
-		AnimSkeleton::getInstance().ReleaseBone(boneName);
+		int boneId = skeleton.GetBoneId(boneName);
+		skeleton.ReleaseBone(boneId);
 
 		if (refNif && refNif->IsValid()) {
-			if (AnimSkeleton::getInstance().GetBoneRefCount(boneName) <= 0) {
+			if (skeleton.GetBoneRefCount(boneId) <= 0) {
 				if (refNif->CanDeleteNode(boneName))
 					refNif->DeleteNode(boneName);
 			}
@@ -108,9 +235,42 @@ void AnimInfo::DeleteVertsForShape(const std::string& shape, const std::vector<u
 	int highestRemoved = indices.back();
 	std::vector<int> indexCollapse = GenerateIndexCollapseMap(indices, highestRemoved + 1);
 
-	auto& skin = shapeSkinning[shape];
-	for (auto& w : skin.boneWeights) {
-		ApplyIndexMapToMapKeys(w.second.weights, indexCollapse, -static_cast<int>(indices.size()));
+	shapeSkinning[shape].weights.RemapVertices(indexCollapse, -static_cast<int>(indices.size()));
+}
+
+void AnimSkin::RemoveBones(const std::vector<std::string>& removeNames) {
+	int boneCount = static_cast<int>(std::max(boneWeights.size(), weights.GetBoneCount()));
+	for (auto& bn : boneNames)
+		boneCount = std::max(boneCount, bn.second + 1);
+
+	std::vector<int> boneMap(boneCount, 0);
+	for (auto& boneName : removeNames) {
+		auto bone = boneNames.find(boneName);
+		if (bone != boneNames.end())
+			boneMap[bone->second] = -1;
+	}
+
+	int newID = 0;
+	for (auto& id : boneMap)
+		if (id == 0)
+			id = newID++;
+
+	size_t keptWeights = 0;
+	for (size_t bone = 0; bone < boneWeights.size(); bone++)
+		if (boneMap[bone] >= 0)
+			boneWeights[keptWeights++] = boneWeights[bone];
+
+	boneWeights.resize(keptWeights);
+	weights.RemapBones(boneMap);
+
+	for (auto bn = boneNames.begin(); bn != boneNames.end();) {
+		if (boneMap[bn->second] < 0) {
+			bn = boneNames.erase(bn);
+			continue;
+		}
+
+		bn->second = boneMap[bn->second];
+		++bn;
 	}
 }
 
@@ -121,13 +281,10 @@ void AnimSkin::InsertVertexIndices(const std::vector<uint16_t>& indices) {
 	int highestAdded = indices.back();
 	std::vector<int> indexExpand = GenerateIndexExpandMap(indices, highestAdded + 1);
 
-	for (auto& w : boneWeights) {
-		ApplyIndexMapToMapKeys(w.second.weights, indexExpand, static_cast<int>(indices.size()));
-	}
+	weights.RemapVertices(indexExpand, static_cast<int>(indices.size()));
 }
 
 void AnimWeight::LoadFromNif(NifFile* loadFromFile, NiShape* shape, const int& index) {
-	loadFromFile->GetShapeBoneWeights(shape, index, weights);
 	loadFromFile->GetShapeTransformSkinToBone(shape, index, xformSkinToBone);
 	loadFromFile->GetShapeBoneBounds(shape, index, bounds);
 }
@@ -137,11 +294,15 @@ void AnimSkin::LoadFromNif(NifFile* loadFromFile, NiShape* shape) {
 	std::vector<int> idList;
 	loadFromFile->GetShapeBoneIDList(shape, idList);
 
+	boneWeights.clear();
+	boneWeights.reserve(idList.size());
+
 	int newID = 0;
 	for (auto& id : idList) {
 		auto node = loadFromFile->GetHeader().GetBlock<NiNode>(id);
 		if (!node)
 			continue;
+		boneWeights.emplace_back();
 		boneWeights[newID].LoadFromNif(loadFromFile, shape, newID);
 		boneNames[node->name.get()] = newID;
 		if (!gotGTS) {
@@ -159,6 +320,27 @@ void AnimSkin::LoadFromNif(NifFile* loadFromFile, NiShape* shape) {
 		}
 		newID++;
 	}
+
+	// BSTriShape keeps up to four influences in each vertex, so the whole matrix is built in one pass over
+	// the vertex data instead of one pass per bone
+	weights.Clear();
+	if (auto bsShape = dynamic_cast<BSTriShape*>(shape)) {
+		if (!bsShape->vertData.empty())
+			weights.SetFromVertices(newID,
+									bsShape->vertData.size(),
+									4,
+									&bsShape->vertData[0].weightBones[0],
+									&bsShape->vertData[0].weights[0],
+									sizeof(bsShape->vertData[0]));
+		return;
+	}
+
+	std::unordered_map<uint16_t, float> boneVertWeights;
+	for (int bone = 0; bone < newID; bone++) {
+		boneVertWeights.clear();
+		loadFromFile->GetShapeBoneWeights(shape, bone, boneVertWeights);
+		weights.AddBone(boneVertWeights);
+	}
 }
 
 bool AnimInfo::LoadFromNif(NifFile* nif) {
@@ -185,15 +367,22 @@ bool AnimInfo::LoadFromNif(NifFile* nif, NiShape* shape, bool newRefNif) {
 	if (!nif->GetShapeBoneList(shape, boneNames))
 		return false;
 
+	AnimSkeleton& skeleton = AnimSkeleton::getInstance();
+	auto& bones = shapeBones[shapeName];
+
 	for (auto& bn : boneNames) {
-		if (!AnimSkeleton::getInstance().RefBone(bn)) {
-			AnimBone* cstm = AnimSkeleton::getInstance().LoadCustomBoneFromNif(nif, bn);
-			if (!cstm->isStandardBone)
-				nonRefBones += bn + "\n";
-			AnimSkeleton::getInstance().RefBone(bn);
+		int boneId = skeleton.GetBoneId(bn);
+		if (boneId < 0) {
+			AnimBone* cstm = skeleton.LoadCustomBoneFromNif(nif, bn);
+			if (cstm) {
+				if (!cstm->isStandardBone)
+					nonRefBones += bn + "\n";
+				boneId = cstm->id;
+			}
 		}
 
-		shapeBones[shapeName].push_back(bn);
+		skeleton.RefBone(boneId);
+		bones.push_back(bn);
 	}
 
 	shapeSkinning[shapeName].LoadFromNif(nif, shape);
@@ -201,9 +390,9 @@ bool AnimInfo::LoadFromNif(NifFile* nif, NiShape* shape, bool newRefNif) {
 }
 
 int AnimInfo::GetShapeBoneIndex(const std::string& shapeName, const std::string& boneName) const {
-	auto& skin = shapeSkinning.find(shapeName);
+	auto skin = shapeSkinning.find(shapeName);
 	if (skin != shapeSkinning.end()) {
-		auto& bone = skin->second.boneNames.find(boneName);
+		auto bone = skin->second.boneNames.find(boneName);
 		if (bone != skin->second.boneNames.end())
 			return bone->second;
 	}
@@ -211,29 +400,20 @@ int AnimInfo::GetShapeBoneIndex(const std::string& shapeName, const std::string&
 	return -1;
 }
 
-std::unordered_map<uint16_t, float>* AnimInfo::GetWeightsPtr(const std::string& shape,
-															 const std::string& boneName) {
+bool AnimInfo::HasWeights(const std::string& shape, const std::string& boneName) {
 	int b = GetShapeBoneIndex(shape, boneName);
 	if (b < 0)
-		return nullptr;
-
-	return &shapeSkinning[shape].boneWeights[b].weights;
-}
-
-bool AnimInfo::HasWeights(const std::string& shape, const std::string& boneName) {
-	auto weights = GetWeightsPtr(shape, boneName);
-	if (weights && weights->size() > 0)
-		return true;
+		return false;
 
-	return false;
+	return shapeSkinning[shape].weights.GetBone(b).size > 0;
 }
 
 void AnimInfo::GetWeights(const std::string& shape,
 						  const std::string& boneName,
 						  std::unordered_map<uint16_t, float>& outVertWeights) {
-	auto weights = GetWeightsPtr(shape, boneName);
-	if (weights)
-		outVertWeights = *weights;
+	int b = GetShapeBoneIndex(shape, boneName);
+	if (b >= 0)
+		shapeSkinning[shape].weights.GetBone(b, outVertWeights);
 }
 
 bool AnimInfo::GetXFormSkinToBone(const std::string& shape,
@@ -243,7 +423,7 @@ bool AnimInfo::GetXFormSkinToBone(const std::string& shape,
 	if (b < 0)
 		return false;
 
-	stransform = shapeSkinning[shape].boneWeights[b].xformSkinToBone;
+	stransform = shapeSkinning[shape].GetBoneWeight(b).xformSkinToBone;
 	return true;
 }
 
@@ -254,7 +434,7 @@ void AnimInfo::SetXFormSkinToBone(const std::string& shape,
 	if (b < 0)
 		return;
 
-	shapeSkinning[shape].boneWeights[b].xformSkinToBone = stransform;
+	shapeSkinning[shape].GetBoneWeight(b).xformSkinToBone = stransform;
 }
 
 void AnimInfo::RecalcXFormSkinToBone(const std::string& shape, const std::string& boneName) {
@@ -269,14 +449,58 @@ void AnimInfo::RecalcXFormSkinToBone(const std::string& shape, const std::string
 }
 
 void AnimInfo::RecursiveRecalcXFormSkinToBone(const std::string& shape, AnimBone* bPtr) {
+	if (!bPtr)
+		return;
+
 	RecalcXFormSkinToBone(shape, bPtr->boneName);
-	for (AnimBone* cptr : bPtr->children)
-		RecursiveRecalcXFormSkinToBone(shape, cptr);
+	for (int child : bPtr->children)
+		RecursiveRecalcXFormSkinToBone(shape, &AnimSkeleton::getInstance().GetBone(child));
 }
 
 void AnimInfo::ChangeGlobalToSkinTransform(const std::string& shape, const MatTransform& newTrans) {
-	shapeSkinning[shape].xformGlobalToSkin = newTrans;
-	RecursiveRecalcXFormSkinToBone(shape, AnimSkeleton::getInstance().GetRootBonePtr());
+	AnimSkin& skin = shapeSkinning[shape];
+	skin.xformGlobalToSkin = newTrans;
+
+	AnimSkeleton& skeleton = AnimSkeleton::getInstance();
+	skeleton.ResolveTransforms();
+
+	// Same bones as RecursiveRecalcXFormSkinToBone from the root, the shape bones below it
+	std::vector<int> shapeBoneIndices;
+	std::vector<const std::string*> shapeBoneNames;
+	std::vector<const AnimBone*> pending;
+	if (const AnimBone* root = skeleton.GetRootBonePtr())
+		pending.push_back(root);
+
+	while (!pending.empty()) {
+		const AnimBone* bone = pending.back();
+		pending.pop_back();
+
+		int b = GetShapeBoneIndex(shape, bone->boneName);
+		if (b >= 0) {
+			shapeBoneIndices.push_back(b);
+			shapeBoneNames.push_back(&bone->boneName);
+		}
+
+		for (int child : bone->children)
+			pending.push_back(&skeleton.GetBone(child));
+	}
+
+	// Composing bone -> global -> skin, then inverting, like RecalcXFormSkinToBone for all bones at once
+	size_t count = shapeBoneIndices.size();
+	TransformArray globalToSkin(count);
+	TransformArray boneToSkin(count);
+	for (size_t i = 0; i < count; i++) {
+		MatTransform xformBoneToGlobal;
+		skeleton.GetBoneTransformToGlobal(*shapeBoneNames[i], xformBoneToGlobal);
+		globalToSkin.Set(i, newTrans);
+		boneToSkin.Set(i, xformBoneToGlobal);
+	}
+
+	TransformBatch::ComposeTransforms(globalToSkin, boneToSkin, boneToSkin);
+	TransformBatch::InverseTransforms(boneToSkin, boneToSkin);
+
+	for (size_t i = 0; i < count; i++)
+		skin.GetBoneWeight(shapeBoneIndices[i]).xformSkinToBone = boneToSkin.Get(i);
 }
 
 bool AnimInfo::CalcShapeSkinBounds(const std::string& shapeName, const int& boneIndex) {
@@ -293,21 +517,70 @@ bool AnimInfo::CalcShapeSkinBounds(const std::string& shapeName, const int& bone
 	if (verts.size() == 0) // Check for empty shape
 		return false;
 
-	std::vector<Vector3> boundVerts;
-	for (auto& w : shapeSkinning[shapeName].boneWeights[boneIndex].weights) {
-		if (w.first >= verts.size()) // Incoming weights have a larger set of possible verts.
-			return false;
+	AnimSkin& skin = shapeSkinning[shapeName];
+	AnimWeight& bw = skin.GetBoneWeight(boneIndex);
 
-		boundVerts.push_back(verts[w.first]);
+	std::vector<Vector3> points;
+	BoundingSphere bounds;
+	if (!CalcBoneBounds(verts, skin.weights.GetBone(boneIndex), boundsMode, points, bounds))
+		return false;
+
+	bw.bounds.center = bw.xformSkinToBone.ApplyTransform(bounds.center);
+	bw.bounds.radius = bounds.radius * bw.xformSkinToBone.scale;
+	return true;
+}
+
+bool AnimInfo::CalcShapeSkinBounds(const std::string& shapeName,
+								   std::vector<bool>& outBoneValid,
+								   NiShape* shape) {
+	outBoneValid.clear();
+
+	if (!refNif || !refNif->IsValid()) // Check for existence of reference nif
+		return false;
+
+	auto skin = shapeSkinning.find(shapeName);
+	if (skin == shapeSkinning.end()) // Check for shape in skinning data
+		return false;
+
+	if (!shape)
+		shape = refNif->FindBlockByName<NiShape>(shapeName);
+
+	std::vector<Vector3> verts;
+	refNif->GetVertsForShape(shape, verts);
+	if (verts.size() == 0) // Check for empty shape
+		return false;
+
+	// The bones only read the shared vertices, so each one could be done on its own thread. Files are
+	// already spread across all cores though, so the bones are done in order and share one buffer.
+	std::vector<Vector3> points;
+	auto& boneWeights = skin->second.boneWeights;
+	size_t boneCount = boneWeights.size();
+	outBoneValid.resize(boneCount);
+
+	// Bounds in skin space first, the centers are then moved to bone space for all bones at once
+	std::vector<float> radii(boneCount);
+	TransformArray skinToBone(boneCount);
+	VectorArray centers(boneCount);
+	for (size_t bone = 0; bone < boneCount; bone++) {
+		BoundingSphere bounds;
+		const SkinWeights::BoneRow row = skin->second.weights.GetBone(bone);
+		outBoneValid[bone] = CalcBoneBounds(verts, row, boundsMode, points, bounds);
+		skinToBone.Set(bone, boneWeights[bone].xformSkinToBone);
+		centers.Set(bone, bounds.center);
+		radii[bone] = bounds.radius;
 	}
 
-	BoundingSphere bounds(boundVerts);
+	TransformBatch::ApplyTransforms(skinToBone, centers, centers);
+
+	for (size_t bone = 0; bone < boneCount; bone++) {
+		if (!outBoneValid[bone])
+			continue;
 
-	const MatTransform& xformSkinToBone = shapeSkinning[shapeName].boneWeights[boneIndex].xformSkinToBone;
+		AnimWeight& bw = boneWeights[bone];
+		bw.bounds.center = centers.Get(bone);
+		bw.bounds.radius = radii[bone] * bw.xformSkinToBone.scale;
+	}
 
-	bounds.center = xformSkinToBone.ApplyTransform(bounds.center);
-	bounds.radius *= xformSkinToBone.scale;
-	shapeSkinning[shapeName].boneWeights[boneIndex].bounds = bounds;
 	return true;
 }
 
@@ -315,112 +588,120 @@ void AnimInfo::SetWeights(const std::string& shape,
 						  const std::string& boneName,
 						  std::unordered_map<uint16_t, float>& inVertWeights) {
 	int bid = GetShapeBoneIndex(shape, boneName);
-	if (bid == 0xFFFFFFFF)
+	if (bid < 0)
 		return;
 
-	shapeSkinning[shape].boneWeights[bid].weights = inVertWeights;
+	shapeSkinning[shape].weights.SetBone(bid, inVertWeights);
 }
 
-void AnimInfo::CleanupBones() {
+std::vector<std::string> AnimInfo::CleanupBones() {
+	std::vector<std::string> cleanedShapes;
+	std::vector<std::string> bonesToDelete;
+
 	for (auto& skin : shapeSkinning) {
-		std::vector<std::string> bonesToDelete;
+		bonesToDelete.clear();
 
 		for (auto& bone : skin.second.boneNames) {
-			bool hasInfluence = false;
-			for (auto& bw : skin.second.boneWeights[bone.second].weights) {
-				if (bw.second > 0.0f) {
-					hasInfluence = true;
-					break;
-				}
-			}
-
-			if (!hasInfluence)
+			if (!skin.second.weights.HasInfluence(bone.second))
 				bonesToDelete.push_back(bone.first);
 		}
 
-		for (auto& bone : bonesToDelete)
-			RemoveShapeBone(skin.first, bone);
+		if (RemoveShapeBones(skin.first, bonesToDelete) > 0)
+			cleanedShapes.push_back(skin.first);
 	}
+
+	return cleanedShapes;
 }
 
 void AnimInfo::WriteToNif(NifFile* nif, const std::string& shapeException) {
 	// Collect list of needed bones.  Also delete bones used by shapeException
 	// and no other shape if they have no children and have root parent.
-	std::unordered_set<const AnimBone*> neededBones;
+	AnimSkeleton& skeleton = AnimSkeleton::getInstance();
+	skeleton.ResolveTransforms();
+	NifBlockIndex blockIndex(nif);
+	std::vector<bool> isNeeded(skeleton.GetBoneCount());
+	std::vector<int> neededBones;
 	for (auto& bones : shapeBones) {
 		for (auto& bone : bones.second) {
-			const AnimBone* bptr = AnimSkeleton::getInstance().GetBonePtr(bone);
-			if (!bptr)
+			int boneId = skeleton.GetBoneId(bone);
+			if (boneId < 0)
 				continue;
 
+			const AnimBone* bptr = &skeleton.GetBone(boneId);
+
 			if (bones.first == shapeException) {
 				if (bptr->refCount <= 1) {
 					if (nif->CanDeleteNode(bone))
-						nif->DeleteNode(bone);
+						blockIndex.DeleteNode(bone);
 				}
 				continue;
 			}
 
-			neededBones.insert(bptr);
+			if (!isNeeded[boneId]) {
+				isNeeded[boneId] = true;
+				neededBones.push_back(boneId);
+			}
 		}
 	}
 
 	// Make sure each needed bone has a node by creating it if necessary.
 	// Also, for each custom bone, set parent and transform to parent.
 	// Also, generate map of bone names to node IDs.
-	std::unordered_map<std::string, int> boneIDMap;
-	for (const AnimBone* bptr : neededBones) {
-		NiNode* node = nif->FindBlockByName<NiNode>(bptr->boneName);
+	std::vector<int> boneNodeIds(skeleton.GetBoneCount(), -1);
+	for (int boneId : neededBones) {
+		const AnimBone* bptr = &skeleton.GetBone(boneId);
+		NiNode* node = blockIndex.FindNode(bptr->boneName);
 		if (!node) {
 			if (bptr->isStandardBone)
 				// If new standard bone, add to root and use xformToGlobal
-				node = nif->AddNode(bptr->boneName, bptr->xformToGlobal);
+				node = blockIndex.AddNode(bptr->boneName, bptr->GetTransformToGlobal());
 			else
 				// If new custom bone, add to parent, recursively
-				node = bptr->AddToNif(nif);
+				node = bptr->AddToNif(blockIndex);
 		}
 		else if (!bptr->isStandardBone) {
 			// If old (exists in nif) custom bone...
-			if (!bptr->parent) {
+			const AnimBone* parentBone = bptr->GetParent();
+			if (!parentBone) {
 				// If old custom bone with no parent, set parent node to root.
-				nif->SetParentNode(node, nullptr);
+				blockIndex.SetParentNode(node, nullptr);
 			}
 			else {
 				// If old custom bone with parent, find parent bone's node
-				NiNode* pNode = nif->FindBlockByName<NiNode>(bptr->parent->boneName);
+				NiNode* pNode = blockIndex.FindNode(parentBone->boneName);
 				if (!pNode)
 					// No parent: add parent recursively.
-					pNode = bptr->parent->AddToNif(nif);
-				nif->SetParentNode(node, pNode);
+					pNode = parentBone->AddToNif(blockIndex);
+				blockIndex.SetParentNode(node, pNode);
 			}
 			node->SetTransformToParent(bptr->xformToParent);
 		}
-		boneIDMap[bptr->boneName] = nif->GetBlockID(node);
+		boneNodeIds[boneId] = blockIndex.GetBlockID(node);
 	}
 
 	// Set the node-to-parent transform for every standard-bone node,
 	// even ones we don't use.
 	for (NiNode* node : nif->GetNodes()) {
-		const AnimBone* bptr = AnimSkeleton::getInstance().GetBonePtr(node->name.get());
+		const AnimBone* bptr = skeleton.GetBonePtr(node->name.get());
 		if (!bptr)
 			continue; // Don't touch bones we don't know about
 		if (!bptr->isStandardBone)
 			continue; // Custom bones have already been set
-		NiNode* pNode = nif->GetParentNode(node);
+		NiNode* pNode = blockIndex.GetParentNode(node);
 		if (!pNode || pNode == nif->GetRootNode())
 			// Parent node is root: use xformToGlobal
-			node->SetTransformToParent(bptr->xformToGlobal);
-		else if (bptr->parent && pNode->name.get() == bptr->parent->boneName)
+			node->SetTransformToParent(bptr->GetTransformToGlobal());
+		else if (bptr->parent >= 0 && pNode->name.get() == skeleton.GetBone(bptr->parent).boneName)
 			// Parent node is bone's parent's node: use xformToParent
 			node->SetTransformToParent(bptr->xformToParent);
 		else {
 			// The parent node does not match our skeletal structure, so we
 			// must calculate the transform.
-			const AnimBone* nparent = AnimSkeleton::getInstance().GetBonePtr(pNode->name.get());
+			const AnimBone* nparent = skeleton.GetBonePtr(pNode->name.get());
 			if (nparent) {
-				MatTransform p2g = nparent->xformToGlobal;
+				MatTransform p2g = nparent->GetTransformToGlobal();
 				// Now compose: bone cs -> global cs -> parent node's bone cs
-				MatTransform b2p = p2g.InverseTransform().ComposeTransforms(bptr->xformToGlobal);
+				MatTransform b2p = p2g.InverseTransform().ComposeTransforms(bptr->GetTransformToGlobal());
 				node->SetTransformToParent(b2p);
 			}
 			// if nparent is nullptr, give up: the node has an unknown
@@ -434,56 +715,84 @@ void AnimInfo::WriteToNif(NifFile* nif, const std::string& shapeException) {
 			continue;
 		std::vector<int> bids;
 		for (auto& bone : bones.second) {
-			auto it = boneIDMap.find(bone);
-			if (it != boneIDMap.end())
-				bids.push_back(it->second);
+			int boneId = skeleton.GetBoneId(bone);
+			if (boneId >= 0 && boneNodeIds[boneId] >= 0)
+				bids.push_back(boneNodeIds[boneId]);
 		}
-		auto shape = nif->FindBlockByName<NiShape>(bones.first);
+		auto shape = blockIndex.FindShape(bones.first);
 		nif->SetShapeBoneIDList(shape, bids);
 	}
 
 	bool incomplete = false;
 	bool isFO4 = nif->GetHeader().GetVersion().IsFO4();
 
+	// Shared by all shapes, so that the vertex weights are rebuilt without allocating per shape or vertex
+	std::vector<VertexInfluences> vertInfluences;
+	std::unordered_map<uint16_t, float> boneVertWeights;
+	std::vector<int> shapeBids;
+	std::vector<bool> boneBoundsValid;
+
 	for (auto& shapeBoneList : shapeBones) {
 		if (shapeBoneList.first == shapeException)
 			continue;
 
-		auto shape = nif->FindBlockByName<NiShape>(shapeBoneList.first);
+		auto shape = blockIndex.FindShape(shapeBoneList.first);
 		if (!shape)
 			continue;
 
-		bool isBSShape = shape->HasType<BSTriShape>();
+		auto bsShape = dynamic_cast<BSTriShape*>(shape);
+		AnimSkin& skin = shapeSkinning[shapeBoneList.first];
+
+		// Indexed by vertex, the rows are transposed back into per-vertex influences
+		if (bsShape)
+			vertInfluences.assign(bsShape->vertData.size(), VertexInfluences());
 
-		std::unordered_map<uint16_t, VertexBoneWeights> vertWeights;
+		shapeBids.clear();
 		for (auto& boneName : shapeBoneList.second) {
-			AnimBone* bptr = AnimSkeleton::getInstance().GetBonePtr(boneName);
+			AnimBone* bptr = skeleton.GetBonePtr(boneName);
 
 			int bid = GetShapeBoneIndex(shapeBoneList.first, boneName);
-			AnimWeight& bw = shapeSkinning[shapeBoneList.first].boneWeights[bid];
+			if (bid < 0)
+				continue;
 
-			if (isBSShape)
-				for (auto vw : bw.weights)
-					vertWeights[vw.first].Add(bid, vw.second);
+			shapeBids.push_back(bid);
+
+			AnimWeight& bw = skin.GetBoneWeight(bid);
+
+			if (bsShape) {
+				SkinWeights::BoneRow row = skin.weights.GetBone(bid);
+				for (size_t i = 0; i < row.size && row.vertices[i] < vertInfluences.size(); i++)
+					vertInfluences[row.vertices[i]].Add(static_cast<uint8_t>(bid), row.weights[i]);
+			}
 
 			nif->SetShapeTransformSkinToBone(shape, bid, bw.xformSkinToBone);
 			if (!bptr)
 				incomplete = true;
-			if (!isFO4)
-				nif->SetShapeBoneWeights(shapeBoneList.first, bid, bw.weights);
+			if (!isFO4) {
+				skin.weights.GetBone(bid, boneVertWeights);
+				nif->SetShapeBoneWeights(shapeBoneList.first, bid, boneVertWeights);
+			}
+		}
 
-			if (CalcShapeSkinBounds(shapeBoneList.first, bid))
-				nif->SetShapeBoneBounds(shapeBoneList.first, bid, bw.bounds);
+		// All bones at once, so that the vertices are only fetched once per shape
+		if (CalcShapeSkinBounds(shapeBoneList.first, boneBoundsValid, nif == refNif ? shape : nullptr)) {
+			for (int bid : shapeBids)
+				if (boneBoundsValid[bid])
+					nif->SetShapeBoneBounds(shapeBoneList.first, bid, skin.boneWeights[bid].bounds);
 		}
 
-		if (isBSShape) {
-			nif->ClearShapeVertWeights(shapeBoneList.first);
+		// Written straight into the vertex data, every vertex gets all of its slots set
+		if (bsShape) {
+			for (size_t vid = 0; vid < vertInfluences.size(); vid++) {
+				VertexInfluences& influences = vertInfluences[vid];
+				influences.Normalize();
 
-			for (auto& vid : vertWeights)
-				nif->SetShapeVertWeights(shapeBoneList.first,
-										 vid.first,
-										 vid.second.boneIds,
-										 vid.second.weights);
+				auto& vertex = bsShape->vertData[vid];
+				for (int i = 0; i < VertexInfluences::MaxCount; i++) {
+					vertex.weights[i] = influences.weights[i];
+					vertex.weightBones[i] = influences.bones[i];
+				}
+			}
 		}
 	}
 }
@@ -500,149 +809,157 @@ void AnimInfo::RenameShape(const std::string& shapeName, const std::string& newS
 	}
 }
 
-AnimBone& AnimBone::LoadFromNif(NifFile* skeletonNif, int srcBlock, AnimBone* inParent) {
-	parent = inParent;
-	isStandardBone = false;
-	auto node = skeletonNif->GetHeader().GetBlock<NiNode>(srcBlock);
-	if (!node)
-		return *this;
-	isStandardBone = true;
-
-	boneName = node->name.get();
-	refCount = 0;
-
-	SetTransformBoneToParent(node->GetTransformToParent());
+AnimBone* AnimBone::GetParent() const {
+	return parent >= 0 ? &AnimSkeleton::getInstance().GetBone(parent) : nullptr;
+}
 
-	for (auto& child : node->childRefs) {
-		std::string name = skeletonNif->GetNodeName(child.index);
-		if (!name.empty()) {
-			if (name == "_unnamed_")
-				name = AnimSkeleton::getInstance().GenerateBoneName();
+NiNode* AnimBone::AddToNif(NifBlockIndex& blockIndex) const {
+	NiNode* pnode = nullptr;
+	if (const AnimBone* parentBone = GetParent()) {
+		pnode = blockIndex.FindNode(parentBone->boneName);
+		if (!pnode)
+			pnode = parentBone->AddToNif(blockIndex);
+	}
+	return blockIndex.AddNode(boneName, xformToParent, pnode);
+}
 
-			AnimBone& bone = AnimSkeleton::getInstance().AddStandardBone(name).LoadFromNif(skeletonNif,
-																						   child.index,
-																						   this);
-			children.push_back(&bone);
+void AnimSkeleton::Clear() {
+	// Custom bones may hang off standard bones
+	for (int id = standardBoneCount; id < GetBoneCount(); id++) {
+		const AnimBone& bone = bones[id];
+		if (bone.parent >= 0 && bone.parent < standardBoneCount) {
+			auto& siblings = bones[bone.parent].children;
+			siblings.erase(std::remove(siblings.begin(), siblings.end(), id), siblings.end());
 		}
+
+		boneIds.erase(bone.boneName);
 	}
 
-	return *this;
+	bones.resize(standardBoneCount);
+
+	for (auto& bone : bones)
+		bone.refCount = 0;
 }
 
-NiNode* AnimBone::AddToNif(NifFile* nif) const {
-	NiNode* pnode = nullptr;
-	if (parent) {
-		pnode = nif->FindBlockByName<NiNode>(parent->boneName);
-		if (!pnode)
-			pnode = parent->AddToNif(nif);
+void AnimSkeleton::SetReference(std::shared_ptr<const RefSkeleton> skeleton) {
+	if (skeleton == reference)
+		return;
+
+	bones.clear();
+	boneIds.clear();
+	standardBoneCount = 0;
+	rootBone = -1;
+	reference = std::move(skeleton);
+
+	if (!reference)
+		return;
+
+	// Bone IDs match the indices of the reference and global transforms were already resolved
+	const auto& refBones = reference->GetBones();
+	bones.reserve(refBones.size());
+
+	for (auto& refBone : refBones) {
+		AnimBone& bone = AddBone(refBone.name, true);
+		bone.xformToParent = refBone.xformToParent;
+		bone.xformToGlobal = refBone.xformToGlobal;
+		bone.xformPoseToGlobal = refBone.xformToGlobal;
+		bone.transformsValid = true;
+
+		if (refBone.parent >= 0) {
+			bone.parent = refBone.parent;
+			bones[bone.parent].children.push_back(bone.id);
+		}
 	}
-	return nif->AddNode(boneName, xformToParent, pnode);
-}
 
-void AnimSkeleton::Clear() {
-	allBones.clear();
-	customBones.clear();
-	refSkeletonNif.Clear();
-	rootBone.clear();
-	unknownCount = 0;
+	standardBoneCount = GetBoneCount();
+	rootBone = 0;
 }
 
 int AnimSkeleton::LoadFromNif(const std::string& fileName) {
-	int error = refSkeletonNif.Load(fileName);
-	if (error)
+	auto skeleton = RefSkeleton::Get(fileName);
+	if (!skeleton)
 		return 1;
 
-	//rootBone = Config["Anim/SkeletonRootName"];
-	int nodeID = refSkeletonNif.GetBlockID(refSkeletonNif.FindBlockByName<NiNode>(rootBone));
-	if (nodeID == 0xFFFFFFFF)
-		return 2;
+	SetReference(std::move(skeleton));
+	return 0;
+}
+
+AnimBone& AnimSkeleton::AddBone(const std::string& boneName, bool isStandardBone) {
+	// The skeleton outlives the file, growing it in an arena would pin the memory of the whole file
+	ArenaPause pause;
 
-	allBones.clear();
-	customBones.clear();
+	auto inserted = boneIds.emplace(boneName, GetBoneCount());
+	if (!inserted.second)
+		return bones[inserted.first->second];
 
-	AddStandardBone(rootBone).LoadFromNif(&refSkeletonNif, nodeID, nullptr);
-	return 0;
+	AnimBone& bone = bones.emplace_back();
+	bone.boneName = boneName;
+	bone.isStandardBone = isStandardBone;
+	bone.id = inserted.first->second;
+	return bone;
 }
 
 AnimBone& AnimSkeleton::AddStandardBone(const std::string& boneName) {
-	return allBones[boneName];
+	return AddBone(boneName, true);
 }
 
 AnimBone& AnimSkeleton::AddCustomBone(const std::string& boneName) {
-	AnimBone* cb = &customBones[boneName];
-	cb->boneName = boneName;
-	return *cb;
-}
-
-std::string AnimSkeleton::GenerateBoneName() {
-	std::stringstream boneName;
-	boneName << "UnnamedBone_" << unknownCount++;
-	return boneName.str();
+	return AddBone(boneName, false);
 }
 
 AnimBone* AnimSkeleton::LoadCustomBoneFromNif(NifFile* nif, const std::string& boneName) {
 	NiNode* node = nif->FindBlockByName<NiNode>(boneName);
 	if (!node)
 		return nullptr;
-	AnimBone* parentBone = nullptr;
+
+	// Work with IDs, adding bones moves the others
+	int parentId = -1;
 	NiNode* parentNode = nif->GetParentNode(node);
 	if (parentNode) {
-		parentBone = GetBonePtr(parentNode->name.get());
-		if (!parentBone)
-			parentBone = LoadCustomBoneFromNif(nif, parentNode->name.get());
+		parentId = GetBoneId(parentNode->name.get());
+		if (parentId < 0) {
+			AnimBone* parentBone = LoadCustomBoneFromNif(nif, parentNode->name.get());
+			if (parentBone)
+				parentId = parentBone->id;
+		}
 	}
-	AnimBone& cstm = AnimSkeleton::getInstance().AddCustomBone(boneName);
+
+	AnimBone& cstm = AddCustomBone(boneName);
 	cstm.SetTransformBoneToParent(node->GetTransformToParent());
-	cstm.SetParentBone(parentBone);
+	cstm.SetParentBone(parentId);
 	return &cstm;
 }
 
-bool AnimSkeleton::RefBone(const std::string& boneName) {
-	if (allBones.find(boneName) != allBones.end()) {
-		allBones[boneName].refCount++;
-		return true;
-	}
-	if (customBones.find(boneName) != customBones.end()) {
-		customBones[boneName].refCount++;
-		return true;
-	}
-	return false;
-}
+bool AnimSkeleton::RefBone(int id) {
+	if (id < 0)
+		return false;
 
-bool AnimSkeleton::ReleaseBone(const std::string& boneName) {
-	if (allBones.find(boneName) != allBones.end()) {
-		allBones[boneName].refCount--;
-		return true;
-	}
-	if (customBones.find(boneName) != customBones.end()) {
-		customBones[boneName].refCount--;
-		return true;
-	}
-	return false;
+	bones[id].refCount++;
+	return true;
 }
 
-int AnimSkeleton::GetBoneRefCount(const std::string& boneName) {
-	if (allBones.find(boneName) != allBones.end())
-		return allBones[boneName].refCount;
+bool AnimSkeleton::ReleaseBone(int id) {
+	if (id < 0)
+		return false;
 
-	if (customBones.find(boneName) != customBones.end())
-		return customBones[boneName].refCount;
+	bones[id].refCount--;
+	return true;
+}
 
-	return 0;
+int AnimSkeleton::GetBoneRefCount(int id) const {
+	return id >= 0 ? bones[id].refCount : 0;
 }
 
 AnimBone* AnimSkeleton::GetBonePtr(const std::string& boneName, const bool allowCustom) {
-	if (allBones.find(boneName) != allBones.end())
-		return &allBones[boneName];
-
-	if (allowCustom && customBones.find(boneName) != customBones.end())
-		return &customBones[boneName];
+	int id = GetBoneId(boneName);
+	if (id < 0 || (!allowCustom && id >= standardBoneCount))
+		return nullptr;
 
-	return nullptr;
+	return &bones[id];
 }
 
 AnimBone* AnimSkeleton::GetRootBonePtr() {
-	return &allBones[rootBone];
+	return rootBone >= 0 ? &bones[rootBone] : nullptr;
 }
 
 bool AnimSkeleton::GetBoneTransformToGlobal(const std::string& boneName, MatTransform& xform) {
@@ -650,23 +967,16 @@ bool AnimSkeleton::GetBoneTransformToGlobal(const std::string& boneName, MatTran
 	if (!bone)
 		return false;
 
-	xform = bone->xformToGlobal;
+	xform = bone->GetTransformToGlobal();
 	//xform.scale = 1.0f; // Scale should be ignored?
 	return true;
 }
 
 int AnimSkeleton::GetActiveBoneNames(std::vector<std::string>& outBoneNames) const {
 	int c = 0;
-	for (auto& ab : allBones) {
-		if (ab.second.refCount > 0) {
-			outBoneNames.push_back(ab.first);
-			c++;
-		}
-	}
-
-	for (auto& cb : customBones) {
-		if (cb.second.refCount > 0) {
-			outBoneNames.push_back(cb.first);
+	for (auto& bone : bones) {
+		if (bone.refCount > 0) {
+			outBoneNames.push_back(bone.boneName);
 			c++;
 		}
 	}
@@ -677,46 +987,136 @@ void AnimSkeleton::DisableCustomTransforms() {
 	allowCustomTransforms = false;
 }
 
-void AnimBone::UpdateTransformToGlobal() {
-	if (parent)
-		xformToGlobal = parent->xformToGlobal.ComposeTransforms(xformToParent);
-	else
-		xformToGlobal = xformToParent;
-	for (AnimBone* cptr : children)
-		cptr->UpdateTransformToGlobal();
+void AnimSkeleton::ResolveTransforms() {
+	// Level of each out of date bone, the number of out of date ancestors it has
+	int boneCount = GetBoneCount();
+	std::vector<int> levels(boneCount, -1);
+	std::vector<int> chain;
+	int levelCount = 0;
+	for (int id = 0; id < boneCount; id++) {
+		// Walks up to the first bone that is valid or has its level already
+		int top = id;
+		while (top >= 0 && !bones[top].transformsValid && levels[top] < 0) {
+			chain.push_back(top);
+			top = bones[top].parent;
+		}
+
+		int level = top >= 0 && !bones[top].transformsValid ? levels[top] + 1 : 0;
+		for (auto it = chain.rbegin(); it != chain.rend(); ++it)
+			levels[*it] = level++;
+
+		levelCount = std::max(levelCount, level);
+		chain.clear();
+	}
+
+	std::vector<std::vector<int>> levelBones(levelCount);
+	for (int id = 0; id < boneCount; id++)
+		if (levels[id] >= 0)
+			levelBones[levels[id]].push_back(id);
+
+	// The parents of a level are valid or in the level before it
+	TransformArray toGlobal;
+	TransformArray poseToGlobal;
+	TransformArray toParent;
+	TransformArray poseToBone;
+	for (auto& level : levelBones) {
+		size_t count = level.size();
+		toGlobal.Resize(count);
+		poseToGlobal.Resize(count);
+		toParent.Resize(count);
+		poseToBone.Resize(count);
+
+		for (size_t i = 0; i < count; i++) {
+			const AnimBone& bone = bones[level[i]];
+			if (bone.parent >= 0) {
+				toGlobal.Set(i, bones[bone.parent].xformToGlobal);
+				poseToGlobal.Set(i, bones[bone.parent].xformPoseToGlobal);
+			}
+			else {
+				toGlobal.Set(i, MatTransform());
+				poseToGlobal.Set(i, MatTransform());
+			}
+
+			MatTransform xformPoseToBone;
+			xformPoseToBone.translation = bone.poseTranVec;
+			xformPoseToBone.rotation = RotVecToMat(bone.poseRotVec);
+			toParent.Set(i, bone.xformToParent);
+			poseToBone.Set(i, xformPoseToBone);
+		}
+
+		// this bone's pose -> this bone -> parent bone's pose -> global, as in AnimBone::ResolveTransforms
+		TransformBatch::ComposeTransforms(toParent, poseToBone, poseToBone);
+		TransformBatch::ComposeTransforms(toGlobal, toParent, toGlobal);
+		TransformBatch::ComposeTransforms(poseToGlobal, poseToBone, poseToGlobal);
+
+		for (size_t i = 0; i < count; i++) {
+			const AnimBone& bone = bones[level[i]];
+			bone.xformToGlobal = toGlobal.Get(i);
+			bone.xformPoseToGlobal = poseToGlobal.Get(i);
+			bone.transformsValid = true;
+		}
+	}
+}
+
+const MatTransform& AnimBone::GetTransformToGlobal() const {
+	if (!transformsValid)
+		ResolveTransforms();
+	return xformToGlobal;
+}
+
+const MatTransform& AnimBone::GetPoseTransformToGlobal() const {
+	if (!transformsValid)
+		ResolveTransforms();
+	return xformPoseToGlobal;
 }
 
-void AnimBone::UpdatePoseTransform() {
+void AnimBone::ResolveTransforms() const {
 	// this bone's pose -> this bone -> parent bone's pose -> global
 	MatTransform xformPoseToBone;
 	xformPoseToBone.translation = poseTranVec;
 	xformPoseToBone.rotation = RotVecToMat(poseRotVec);
 	MatTransform xformPoseToParent = xformToParent.ComposeTransforms(xformPoseToBone);
-	if (parent)
-		xformPoseToGlobal = parent->xformPoseToGlobal.ComposeTransforms(xformPoseToParent);
-	else
+
+	// Only goes up as far as the first parent that is still valid
+	if (const AnimBone* parentBone = GetParent()) {
+		xformToGlobal = parentBone->GetTransformToGlobal().ComposeTransforms(xformToParent);
+		xformPoseToGlobal = parentBone->GetPoseTransformToGlobal().ComposeTransforms(xformPoseToParent);
+	}
+	else {
+		xformToGlobal = xformToParent;
 		xformPoseToGlobal = xformPoseToParent;
-	for (AnimBone* cptr : children)
-		cptr->UpdatePoseTransform();
+	}
+
+	transformsValid = true;
+}
+
+void AnimBone::InvalidateTransforms() {
+	if (!transformsValid)
+		return;
+
+	transformsValid = false;
+	for (int child : children)
+		AnimSkeleton::getInstance().GetBone(child).InvalidateTransforms();
 }
 
 void AnimBone::SetTransformBoneToParent(const MatTransform& ttp) {
 	xformToParent = ttp;
-	UpdateTransformToGlobal();
-	UpdatePoseTransform();
+	InvalidateTransforms();
 }
 
-void AnimBone::SetParentBone(AnimBone* newParent) {
+void AnimBone::SetParentBone(int newParent) {
 	if (parent == newParent)
 		return;
-	if (parent) {
-		//std::erase(parent->children, this);
-		auto it = std::remove(parent->children.begin(), parent->children.end(), this);
-		parent->children.erase(it, parent->children.end());
+	AnimSkeleton& skeleton = AnimSkeleton::getInstance();
+	if (parent >= 0) {
+		auto& siblings = skeleton.GetBone(parent).children;
+		siblings.erase(std::remove(siblings.begin(), siblings.end(), id), siblings.end());
 	}
 	parent = newParent;
-	if (parent)
-		parent->children.push_back(this);
-	UpdateTransformToGlobal();
-	UpdatePoseTransform();
+	if (parent >= 0) {
+		// Standard bones outlive the file
+		ArenaPause pause;
+		skeleton.GetBone(parent).children.push_back(id);
+	}
+	InvalidateTransforms();
 }
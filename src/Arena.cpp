@@ -0,0 +1,256 @@
+/*
+SSE NIF Optimizer
+See the included LICENSE file
+*/
+
+#include "Arena.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+
+#ifdef _WINDOWS
+#include "PlatformUtil.hpp"
+#else
+#include <sys/mman.h>
+#endif
+
+namespace {
+// Address space is reserved once for all threads, so that Free can tell arena memory apart with a range
+// check. Memory is only committed as it's used.
+constexpr bool ArenaSupported = sizeof(void*) >= 8;
+constexpr size_t SliceBytes = ArenaSupported ? size_t(1) << 30 : 0;
+constexpr size_t MaxSlices = 256;
+constexpr size_t CommitStep = size_t(1) << 20;
+constexpr size_t RetainBytes = size_t(32) << 20; // Kept committed between files, the rest is released
+constexpr size_t Alignment = 16;
+
+// In front of every allocation, keeps the payload aligned
+struct alignas(Alignment) Header {
+	size_t blockSize;
+	uint32_t epoch;
+};
+
+struct Slice {
+	char* begin;
+	size_t top;
+	size_t epochStart;
+	size_t committed;
+
+	// Epoch in the upper half, allocations of the epoch that are still alive in the lower half.
+	// Only the owning thread starts a new epoch, any thread may count down.
+	std::atomic<uint64_t> state;
+};
+
+std::atomic<uintptr_t> regionAddress{0};
+std::atomic<uint64_t> pinnedBytes{0};
+bool reserveFailed = false;
+
+std::mutex sliceMutex;
+Slice slices[MaxSlices];
+size_t usedSlices = 0;
+size_t freeSlices[MaxSlices];
+size_t freeCount = 0;
+
+// Plain data only, so that no thread_local initialization runs inside operator new
+thread_local Slice* activeSlice = nullptr;
+thread_local Slice* scopeSlice = nullptr;
+thread_local int scopeDepth = 0;
+
+char* Reserve(size_t size) {
+#ifdef _WINDOWS
+	return static_cast<char*>(VirtualAlloc(nullptr, size, MEM_RESERVE, PAGE_NOACCESS));
+#else
+	int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_NORESERVE
+	flags |= MAP_NORESERVE;
+#endif
+	void* ptr = mmap(nullptr, size, PROT_NONE, flags, -1, 0);
+	return ptr != MAP_FAILED ? static_cast<char*>(ptr) : nullptr;
+#endif
+}
+
+bool Commit(char* ptr, size_t size) {
+#ifdef _WINDOWS
+	return VirtualAlloc(ptr, size, MEM_COMMIT, PAGE_READWRITE) != nullptr;
+#else
+	return mprotect(ptr, size, PROT_READ | PROT_WRITE) == 0;
+#endif
+}
+
+void Decommit(char* ptr, size_t size) {
+#ifdef _WINDOWS
+	VirtualFree(ptr, size, MEM_DECOMMIT);
+#else
+	// Mapping fresh pages over the range hands the memory back to the OS
+	int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED;
+#ifdef MAP_NORESERVE
+	flags |= MAP_NORESERVE;
+#endif
+	mmap(ptr, size, PROT_NONE, flags, -1, 0);
+#endif
+}
+
+Slice* AcquireSlice() {
+	if (!ArenaSupported)
+		return nullptr;
+
+	std::lock_guard<std::mutex> lock(sliceMutex);
+	if (freeCount > 0)
+		return &slices[freeSlices[--freeCount]];
+
+	char* base = reinterpret_cast<char*>(regionAddress.load(std::memory_order_relaxed));
+	if (!base) {
+		if (reserveFailed)
+			return nullptr;
+
+		base = Reserve(SliceBytes * MaxSlices);
+		if (!base) {
+			reserveFailed = true;
+			return nullptr;
+		}
+
+		regionAddress.store(reinterpret_cast<uintptr_t>(base), std::memory_order_release);
+	}
+
+	if (usedSlices == MaxSlices)
+		return nullptr;
+
+	Slice& slice = slices[usedSlices];
+	slice.begin = base + usedSlices * SliceBytes;
+	usedSlices++;
+	return &slice;
+}
+
+// Hands the slice of a thread to the next thread that needs one when the thread exits
+struct SliceOwner {
+	Slice* slice = nullptr;
+
+	~SliceOwner() {
+		if (!slice)
+			return;
+
+		std::lock_guard<std::mutex> lock(sliceMutex);
+		freeSlices[freeCount++] = static_cast<size_t>(slice - slices);
+	}
+};
+
+void EndEpoch(Slice& slice) {
+	uint64_t epoch = slice.state.load(std::memory_order_relaxed) >> 32;
+	uint64_t next = ((epoch + 1) & 0xFFFFFFFF) << 32;
+
+	// Frees of the old epoch that come in later don't match anymore and are ignored
+	uint64_t old = slice.state.exchange(next, std::memory_order_acq_rel);
+	if ((old & 0xFFFFFFFF) != 0) {
+		pinnedBytes.fetch_add(slice.top - slice.epochStart, std::memory_order_relaxed);
+		slice.epochStart = slice.top;
+		return;
+	}
+
+	slice.top = slice.epochStart;
+
+	size_t retain = (slice.epochStart + RetainBytes + CommitStep - 1) / CommitStep * CommitStep;
+	retain = std::min(retain, SliceBytes);
+	if (slice.committed > retain) {
+		Decommit(slice.begin + retain, slice.committed - retain);
+		slice.committed = retain;
+	}
+}
+} // namespace
+
+void* Arena::Allocate(size_t size, size_t& blockSize) {
+	Slice* slice = activeSlice;
+	if (!slice || size > SliceBytes)
+		return nullptr;
+
+	size_t total = sizeof(Header) + (std::max<size_t>(size, 1) + Alignment - 1) / Alignment * Alignment;
+	if (total > SliceBytes - slice->top)
+		return nullptr;
+
+	size_t end = slice->top + total;
+	if (end > slice->committed) {
+		size_t committed = std::min(SliceBytes, (end + CommitStep - 1) / CommitStep * CommitStep);
+		if (!Commit(slice->begin + slice->committed, committed - slice->committed))
+			return nullptr;
+
+		slice->committed = committed;
+	}
+
+	Header* header = reinterpret_cast<Header*>(slice->begin + slice->top);
+	header->blockSize = total;
+	header->epoch = static_cast<uint32_t>(slice->state.fetch_add(1, std::memory_order_relaxed) >> 32);
+
+	slice->top = end;
+	blockSize = total;
+	return header + 1;
+}
+
+uint64_t Arena::GetPinnedBytes() {
+	return pinnedBytes.load(std::memory_order_relaxed);
+}
+
+bool Arena::Free(void* ptr, size_t& blockSize) {
+	uintptr_t base = regionAddress.load(std::memory_order_acquire);
+	uintptr_t offset = reinterpret_cast<uintptr_t>(ptr) - base;
+	if (!base || offset >= SliceBytes * MaxSlices)
+		return false;
+
+	Slice& slice = slices[offset / SliceBytes];
+	const Header* header = static_cast<const Header*>(ptr) - 1;
+	blockSize = header->blockSize;
+
+	// Release, so that the owner doesn't reuse the memory before the object is done with
+	uint64_t state = slice.state.load(std::memory_order_relaxed);
+	while ((state >> 32) == header->epoch
+		   && !slice.state.compare_exchange_weak(state, state - 1, std::memory_order_release,
+												 std::memory_order_relaxed)) {
+	}
+
+	return true;
+}
+
+ArenaScope::ArenaScope(bool enabled) {
+	if (!enabled)
+		return;
+
+	if (scopeDepth == 0) {
+		static thread_local SliceOwner owner;
+		if (!owner.slice)
+			owner.slice = AcquireSlice();
+
+		if (!owner.slice)
+			return;
+
+		scopeSlice = owner.slice;
+		activeSlice = owner.slice;
+	}
+
+	scopeDepth++;
+	active = true;
+}
+
+ArenaScope::~ArenaScope() {
+	if (!active || --scopeDepth > 0)
+		return;
+
+	activeSlice = nullptr;
+	EndEpoch(*scopeSlice);
+	scopeSlice = nullptr;
+}
+
+size_t ArenaScope::GetUsedBytes() const {
+	if (!active)
+		return 0;
+
+	return scopeSlice->top - scopeSlice->epochStart;
+}
+
+ArenaPause::ArenaPause()
+	: pausedSlice(activeSlice) {
+	activeSlice = nullptr;
+}
+
+ArenaPause::~ArenaPause() {
+	activeSlice = static_cast<Slice*>(pausedSlice);
+}
@@ -0,0 +1,149 @@
+/*
+SSE NIF Optimizer
+See the included LICENSE file
+*/
+
+#include "AsyncLog.hpp"
+#include "PlatformUtil.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace {
+// The writer wakes up early once this much is buffered, otherwise after the interval
+constexpr size_t BatchBytes = 64 * 1024;
+constexpr auto FlushInterval = std::chrono::milliseconds(100);
+} // namespace
+
+AsyncLog::AsyncLog(size_t capacity)
+	: ring(std::max<size_t>(capacity, 1))
+	, batchBytes(std::min(BatchBytes, std::max<size_t>(capacity / 2, 1))) {}
+
+AsyncLog::~AsyncLog() {
+	Close();
+}
+
+bool AsyncLog::Open(const std::string& fileName) {
+	Close();
+
+	PlatformUtil::OpenFileStream(file, fileName, std::ios::out | std::ios::binary);
+	if (!file)
+		return false;
+
+	readPos = 0;
+	used = 0;
+	queuedBytes = 0;
+	writtenBytes = 0;
+	flushRequests = 0;
+	writing = false;
+	stopping = false;
+
+	writerThread = std::thread(&AsyncLog::WriterLoop, this);
+	return true;
+}
+
+void AsyncLog::Close() {
+	if (!writerThread.joinable())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+
+	dataCondition.notify_one();
+	writerThread.join();
+	file.close();
+}
+
+void AsyncLog::Write(const char* data, size_t size) {
+	if (size == 0)
+		return;
+
+	std::unique_lock<std::mutex> lock(mutex);
+	if (!writerThread.joinable() || stopping)
+		return;
+
+	const size_t capacity = ring.size();
+
+	// Messages that don't fit into the buffer go straight to the file once it has been drained
+	if (size > capacity) {
+		flushRequests++;
+		dataCondition.notify_one();
+		spaceCondition.wait(lock, [this] { return used == 0 && !writing; });
+		flushRequests--;
+		file.write(data, size);
+		queuedBytes += size;
+		writtenBytes += size;
+		return;
+	}
+
+	if (capacity - used < size) {
+		dataCondition.notify_one();
+		spaceCondition.wait(lock, [&] { return capacity - used >= size; });
+	}
+
+	size_t writePos = (readPos + used) % capacity;
+	size_t firstPart = std::min(size, capacity - writePos);
+	std::memcpy(&ring[writePos], data, firstPart);
+	std::memcpy(&ring[0], data + firstPart, size - firstPart);
+
+	used += size;
+	queuedBytes += size;
+
+	if (used >= batchBytes)
+		dataCondition.notify_one();
+}
+
+void AsyncLog::WriteLine(const std::string& line, const char* lineEnd) {
+	Write(line + lineEnd);
+}
+
+void AsyncLog::Flush() {
+	std::unique_lock<std::mutex> lock(mutex);
+	if (!writerThread.joinable())
+		return;
+
+	uint64_t target = queuedBytes;
+	flushRequests++;
+	dataCondition.notify_one();
+
+	spaceCondition.wait(lock, [&] { return writtenBytes >= target; });
+	flushRequests--;
+}
+
+void AsyncLog::WriterLoop() {
+	std::unique_lock<std::mutex> lock(mutex);
+
+	for (;;) {
+		dataCondition.wait_for(lock, FlushInterval, [this] {
+			return stopping || (used > 0 && (flushRequests > 0 || used >= batchBytes));
+		});
+
+		if (used == 0) {
+			if (stopping)
+				break;
+
+			continue;
+		}
+
+		// Write the contiguous part of the buffer without holding the lock.
+		// Writers only append behind it, so the range stays untouched.
+		size_t start = readPos;
+		size_t count = std::min(used, ring.size() - readPos);
+		writing = true;
+
+		lock.unlock();
+		file.write(&ring[start], count);
+		file.flush();
+		lock.lock();
+
+		writing = false;
+		readPos = (readPos + count) % ring.size();
+		used -= count;
+		writtenBytes += count;
+
+		spaceCondition.notify_all();
+	}
+}
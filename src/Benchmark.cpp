@@ -0,0 +1,936 @@
+/*
+SSE NIF Optimizer
+See the included LICENSE file
+*/
+
+#include "Anim.hpp"
+#include "FileView.hpp"
+#include "Hash.hpp"
+#include "Instrumentation.hpp"
+#include "MemoryStream.hpp"
+#include "OptimizerCore.hpp"
+#include "PlatformUtil.hpp"
+#include "ThreadPool.hpp"
+#include "TransformBatch.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+
+using namespace nifly;
+
+namespace {
+// Bumped whenever the generated corpus changes, so that results of different corpora aren't compared
+constexpr int CorpusVersion = 1;
+
+// SplitMix64, used instead of <random> distributions to produce the same corpus with every compiler
+class Random {
+public:
+	explicit Random(uint64_t seed)
+		: state(seed) {}
+
+	uint64_t Next() {
+		uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+		return z ^ (z >> 31);
+	}
+
+	// 24 random bits, exactly representable as float
+	float Float(float min, float max) {
+		return min + (max - min) * static_cast<float>(Next() >> 40) / 16777216.0f;
+	}
+
+	int Int(int count) { return static_cast<int>(Next() % static_cast<uint64_t>(count)); }
+
+private:
+	uint64_t state;
+};
+
+struct CorpusFile {
+	std::string name;
+	std::vector<char> data;
+};
+
+struct Category {
+	std::string name;
+	bool headParts = false;
+	std::vector<CorpusFile> files;
+};
+
+struct BenchmarkOptions {
+	int scale = 1;
+	int iterations = 5;
+	int jobs = 1;
+	uint64_t seed = 1;
+	std::string corpusFolder;
+	std::string jsonPath;
+};
+
+// Measurements of one category, accumulated over all files of one iteration
+struct IterationResult {
+	uint64_t wallNanoseconds = 0;
+	uint64_t phaseNanoseconds[PhaseCount]{};
+	uint64_t allocations = 0;
+	uint64_t arenaAllocations = 0;
+	uint64_t maxFileBytes = 0; // Highest memory use of a single file
+	size_t failed = 0;
+};
+
+// Wavy grid of columns x rows vertices
+NiShape* AddGridShape(NifFile& nif, const std::string& name, int columns, int rows, Random& rng) {
+	std::vector<Vector3> verts;
+	std::vector<Vector3> normals;
+	std::vector<Vector2> uvs;
+	std::vector<Triangle> tris;
+
+	verts.reserve(columns * rows);
+	normals.reserve(columns * rows);
+	uvs.reserve(columns * rows);
+	tris.reserve((columns - 1) * (rows - 1) * 2);
+
+	Vector3 offset(rng.Float(-100.0f, 100.0f), rng.Float(-100.0f, 100.0f), rng.Float(0.0f, 100.0f));
+
+	for (int y = 0; y < rows; y++) {
+		for (int x = 0; x < columns; x++) {
+			float height = rng.Float(-0.5f, 0.5f) + static_cast<float>((x * 7 + y * 3) % 11) * 0.1f;
+			verts.emplace_back(offset.x + x, offset.y + y, offset.z + height);
+			normals.emplace_back(0.0f, 0.0f, 1.0f);
+			uvs.emplace_back(static_cast<float>(x) / (columns - 1), static_cast<float>(y) / (rows - 1));
+		}
+	}
+
+	for (int y = 0; y + 1 < rows; y++) {
+		for (int x = 0; x + 1 < columns; x++) {
+			auto i = static_cast<uint16_t>(y * columns + x);
+			auto right = static_cast<uint16_t>(i + 1);
+			auto down = static_cast<uint16_t>(i + columns);
+			auto diagonal = static_cast<uint16_t>(down + 1);
+			tris.emplace_back(i, right, diagonal);
+			tris.emplace_back(i, diagonal, down);
+		}
+	}
+
+	return nif.CreateShapeFromData(name, &verts, &tris, &uvs, &normals);
+}
+
+// Skins the shape to a chain of bones with up to four influences per vertex
+void AddSkinning(NifFile& nif, NiShape* shape, const std::string& shapeName, int boneCount, Random& rng) {
+	nif.CreateSkinning(shape);
+
+	std::vector<int> boneIDs;
+	NiNode* parent = nif.GetRootNode();
+
+	for (int i = 0; i < boneCount; i++) {
+		MatTransform xformToParent;
+		xformToParent.translation.x = rng.Float(-5.0f, 5.0f);
+		xformToParent.translation.y = rng.Float(-5.0f, 5.0f);
+		xformToParent.translation.z = rng.Float(1.0f, 10.0f);
+
+		char boneName[32];
+		std::snprintf(boneName, sizeof(boneName), "Bench Bone %03d", i);
+
+		NiNode* node = nif.AddNode(boneName, xformToParent, parent);
+		boneIDs.push_back(nif.GetBlockID(node));
+
+		// Short chains like limbs and fingers
+		parent = (i % 8 == 7) ? nif.GetRootNode() : node;
+	}
+
+	nif.SetShapeBoneIDList(shape, boneIDs);
+
+	std::vector<Vector3> verts;
+	nif.GetVertsForShape(shape, verts);
+
+	std::vector<std::unordered_map<uint16_t, float>> boneWeights(boneCount);
+	for (size_t v = 0; v < verts.size(); v++) {
+		int influences = 1 + rng.Int(4);
+		float weights[4];
+		float sum = 0.0f;
+
+		for (int j = 0; j < influences; j++) {
+			weights[j] = rng.Float(0.05f, 1.0f);
+			sum += weights[j];
+		}
+
+		int firstBone = rng.Int(boneCount);
+		for (int j = 0; j < influences; j++)
+			boneWeights[(firstBone + j) % boneCount][static_cast<uint16_t>(v)] += weights[j] / sum;
+	}
+
+	for (int i = 0; i < boneCount; i++) {
+		MatTransform xformSkinToBone;
+		xformSkinToBone.translation = Vector3(rng.Float(-50.0f, 50.0f), rng.Float(-50.0f, 50.0f), 0.0f);
+
+		nif.SetShapeTransformSkinToBone(shape, i, xformSkinToBone);
+		nif.SetShapeBoneWeights(shapeName, i, boneWeights[i]);
+	}
+
+	nif.UpdateSkinPartitions(shape);
+}
+
+bool SaveToBuffer(NifFile& nif, std::vector<char>& data) {
+	MemoryOutputBuf outBuf(data);
+	std::ostream outStream(&outBuf);
+
+	if (nif.Save(outStream) != 0 || !outStream.good())
+		return false;
+
+	outBuf.Finish();
+	return true;
+}
+
+void AddFile(Category& category, const std::string& name, NifFile& nif) {
+	CorpusFile file;
+	file.name = category.name + "/" + name;
+
+	if (SaveToBuffer(nif, file.data))
+		category.files.push_back(std::move(file));
+	else
+		std::cerr << "Failed to generate '" << file.name << "'.\n";
+}
+
+// Files are created in the Skyrim LE format, so optimizing them for SSE runs the full conversion
+std::vector<Category> GenerateCorpus(int scale, uint64_t seed) {
+	NiVersion version = OptimizerCore::GetTargetVersion(TargetGame::LE);
+	Random rng(seed);
+
+	std::vector<Category> corpus(5);
+	Category& statics = corpus[0];
+	Category& skinned = corpus[1];
+	Category& headParts = corpus[2];
+	Category& terrain = corpus[3];
+	Category& large = corpus[4];
+
+	statics.name = "static";
+	skinned.name = "skinned";
+	headParts.name = "headparts";
+	headParts.headParts = true;
+	terrain.name = "terrain";
+	large.name = "large";
+
+	for (int i = 0; i < 40 * scale; i++) {
+		NifFile nif;
+		nif.Create(version);
+
+		int shapeCount = 1 + rng.Int(3);
+		for (int s = 0; s < shapeCount; s++)
+			AddGridShape(nif, "Static" + std::to_string(s), 16 + rng.Int(48), 16 + rng.Int(48), rng);
+
+		AddFile(statics, "static" + std::to_string(i) + ".nif", nif);
+	}
+
+	for (int i = 0; i < 10 * scale; i++) {
+		NifFile nif;
+		nif.Create(version);
+
+		for (int s = 0; s < 2; s++) {
+			std::string shapeName = "Body" + std::to_string(s);
+			NiShape* shape = AddGridShape(nif, shapeName, 96, 96, rng);
+			AddSkinning(nif, shape, shapeName, 40 + rng.Int(60), rng);
+		}
+
+		AddFile(skinned, "skinned" + std::to_string(i) + ".nif", nif);
+	}
+
+	for (int i = 0; i < 10 * scale; i++) {
+		NifFile nif;
+		nif.Create(version);
+
+		std::string shapeName = "Head" + std::to_string(i);
+		NiShape* shape = AddGridShape(nif, shapeName, 64, 64, rng);
+		AddSkinning(nif, shape, shapeName, 8 + rng.Int(8), rng);
+
+		AddFile(headParts, "head" + std::to_string(i) + ".nif", nif);
+	}
+
+	for (int i = 0; i < 10 * scale; i++) {
+		NifFile nif;
+		nif.Create(version);
+		AddGridShape(nif, "Terrain", 33, 33, rng);
+
+		// Every other file is an object LOD file
+		AddFile(terrain, "terrain" + std::to_string(i) + (i % 2 == 0 ? ".btr" : ".bto"), nif);
+	}
+
+	for (int i = 0; i < 2 * scale; i++) {
+		NifFile nif;
+		nif.Create(version);
+
+		for (int s = 0; s < 64; s++)
+			AddGridShape(nif, "Part" + std::to_string(s), 64, 64, rng);
+
+		AddFile(large, "large" + std::to_string(i) + ".nif", nif);
+	}
+
+	return corpus;
+}
+
+bool WriteCorpus(const std::vector<Category>& corpus, const std::string& folder) {
+	for (auto& category : corpus) {
+		std::error_code ec;
+		std::filesystem::create_directories(std::filesystem::u8path(folder + "/" + category.name), ec);
+		if (ec)
+			return false;
+
+		for (auto& file : category.files)
+			if (!PlatformUtil::WriteFile(folder + "/" + file.name, file.data.data(), file.data.size()))
+				return false;
+	}
+
+	return true;
+}
+
+IterationResult RunCategory(const Category& category, ThreadPool* pool, bool arenaAlloc = false) {
+	OptimizerOptions options;
+	options.headParts = category.headParts;
+	options.smoothNormals = true;
+	options.skipOptimized = false;
+	options.arenaAlloc = arenaAlloc;
+
+	std::vector<FileResult> results(category.files.size());
+
+	auto optimize = [&](size_t i) {
+		const CorpusFile& file = category.files[i];
+		std::vector<char> outData;
+		results[i] = OptimizerCore::OptimizeBuffer(file.data,
+												   outData,
+												   OptimizerCore::GetLoadOptions(file.name),
+												   options);
+	};
+
+	auto start = std::chrono::steady_clock::now();
+
+	if (pool) {
+		std::vector<std::future<void>> futures;
+		for (size_t i = 0; i < category.files.size(); i++)
+			futures.push_back(pool->Submit([&optimize, i]() { optimize(i); }));
+
+		for (auto& future : futures)
+			future.wait();
+	}
+	else {
+		for (size_t i = 0; i < category.files.size(); i++)
+			optimize(i);
+	}
+
+	IterationResult iteration;
+	iteration.wallNanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(
+									std::chrono::steady_clock::now() - start)
+									.count();
+
+	for (auto& result : results) {
+		if (result.status != FileStatus::Saved && result.status != FileStatus::Identical)
+			iteration.failed++;
+
+		// An arena doesn't reuse freed memory, so everything it handed out counts
+		uint64_t fileBytes = result.stats.arenaBytes;
+
+		for (size_t p = 0; p < PhaseCount; p++) {
+			const PhaseStats& phase = result.stats.phases[p];
+			iteration.phaseNanoseconds[p] += phase.nanoseconds;
+			iteration.allocations += phase.allocations;
+			iteration.arenaAllocations += phase.arenaAllocations;
+			fileBytes = std::max(fileBytes, phase.peakBytes);
+		}
+
+		iteration.maxFileBytes = std::max(iteration.maxFileBytes, fileBytes);
+	}
+
+	return iteration;
+}
+
+// Loads every file from disk, either through a mapping or read with a stream. Returns the wall time.
+uint64_t RunLoading(const std::vector<std::string>& files, bool mapped, size_t& failed) {
+	auto start = std::chrono::steady_clock::now();
+
+	for (auto& file : files) {
+		FileView input;
+		if (!input.Open(file, mapped)) {
+			failed++;
+			continue;
+		}
+
+		MemoryInputBuf inBuf(input.GetData(), input.GetSize());
+		std::istream inStream(&inBuf);
+
+		NifFile nif;
+		if (nif.Load(inStream, OptimizerCore::GetLoadOptions(file)) != 0)
+			failed++;
+	}
+
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start)
+		.count();
+}
+
+struct SkeletonResult {
+	uint64_t buildNanoseconds = 0;
+	uint64_t resolveNanoseconds = 0;
+};
+
+// Builds a custom creature skeleton, mostly long chains like spines, tails and tentacles with a branch now
+// and then, and reads the global transforms of all bones. Linking children before their parents moves
+// whole subtrees, the worst case for updating transforms with every change.
+SkeletonResult RunSkeleton(const std::vector<int>& parents, bool parentsFirst, uint64_t seed) {
+	SkeletonResult result;
+	Random rng(seed);
+	int boneCount = static_cast<int>(parents.size());
+
+	AnimSkeleton& skeleton = AnimSkeleton::getInstance();
+	skeleton.Clear();
+
+	auto start = std::chrono::steady_clock::now();
+
+	std::vector<int> ids(boneCount);
+	for (int i = 0; i < boneCount; i++) {
+		MatTransform xform;
+		xform.translation = Vector3(0.0f, 0.0f, rng.Float(1.0f, 5.0f));
+		xform.rotation = RotVecToMat(
+			Vector3(rng.Float(-0.3f, 0.3f), rng.Float(-0.3f, 0.3f), rng.Float(-0.3f, 0.3f)));
+
+		AnimBone& bone = skeleton.AddCustomBone("CreatureBone" + std::to_string(i));
+		bone.SetTransformBoneToParent(xform);
+		ids[i] = bone.id;
+	}
+
+	for (int n = 0; n < boneCount; n++) {
+		int i = parentsFirst ? n : boneCount - 1 - n;
+		if (parents[i] >= 0)
+			skeleton.GetBone(ids[i]).SetParentBone(ids[parents[i]]);
+	}
+
+	auto built = std::chrono::steady_clock::now();
+
+	float sum = 0.0f;
+	for (int id : ids)
+		sum += skeleton.GetBone(id).GetTransformToGlobal().translation.z;
+
+	auto resolved = std::chrono::steady_clock::now();
+
+	// Keeps the reads from being optimized away
+	volatile float sink = sum;
+	(void)sink;
+
+	skeleton.Clear();
+
+	using std::chrono::duration_cast;
+	using std::chrono::nanoseconds;
+	result.buildNanoseconds = duration_cast<nanoseconds>(built - start).count();
+	result.resolveNanoseconds = duration_cast<nanoseconds>(resolved - built).count();
+	return result;
+}
+
+enum class TransformOp { Compose, Inverse, Apply, Count };
+
+const char* GetTransformOpName(TransformOp op) {
+	switch (op) {
+		case TransformOp::Compose: return "compose";
+		case TransformOp::Inverse: return "inverse";
+		default: return "apply";
+	}
+}
+
+// The same random transforms and vectors, as MatTransform and in batch form
+struct TransformData {
+	std::vector<MatTransform> a;
+	std::vector<MatTransform> b;
+	std::vector<Vector3> vecs;
+	TransformArray batchA;
+	TransformArray batchB;
+	VectorArray batchVecs;
+};
+
+TransformData GenerateTransforms(int count, uint64_t seed) {
+	TransformData data;
+	Random rng(seed);
+
+	auto randomTransform = [&]() {
+		MatTransform xform;
+		xform.translation = Vector3(
+			rng.Float(-50.0f, 50.0f), rng.Float(-50.0f, 50.0f), rng.Float(-50.0f, 50.0f));
+		xform.rotation = RotVecToMat(
+			Vector3(rng.Float(-3.0f, 3.0f), rng.Float(-3.0f, 3.0f), rng.Float(-3.0f, 3.0f)));
+		xform.scale = rng.Float(0.5f, 2.0f);
+		return xform;
+	};
+
+	data.batchA.Resize(count);
+	data.batchB.Resize(count);
+	data.batchVecs.Resize(count);
+	for (int i = 0; i < count; i++) {
+		data.a.push_back(randomTransform());
+		data.b.push_back(randomTransform());
+		data.vecs.emplace_back(rng.Float(-50.0f, 50.0f), rng.Float(-50.0f, 50.0f), rng.Float(-50.0f, 50.0f));
+		data.batchA.Set(i, data.a.back());
+		data.batchB.Set(i, data.b.back());
+		data.batchVecs.Set(i, data.vecs.back());
+	}
+
+	return data;
+}
+
+// Runs an operation over all transforms a number of times, with the MatTransform functions if kernel is
+// nullptr, otherwise with the batch functions
+uint64_t RunTransforms(const TransformData& data, TransformOp op, const TransformKernel* kernel, int rounds) {
+	size_t count = data.a.size();
+	std::vector<MatTransform> xforms(count);
+	std::vector<Vector3> vecs(count);
+	TransformArray batchXforms(count);
+	VectorArray batchVecs(count);
+
+	auto start = std::chrono::steady_clock::now();
+
+	for (int round = 0; round < rounds; round++) {
+		if (kernel) {
+			switch (op) {
+				case TransformOp::Compose:
+					TransformBatch::ComposeTransforms(data.batchA, data.batchB, batchXforms, *kernel);
+					break;
+				case TransformOp::Inverse:
+					TransformBatch::InverseTransforms(data.batchA, batchXforms, *kernel);
+					break;
+				default:
+					TransformBatch::ApplyTransforms(data.batchA, data.batchVecs, batchVecs, *kernel);
+					break;
+			}
+		}
+		else {
+			for (size_t i = 0; i < count; i++) {
+				switch (op) {
+					case TransformOp::Compose: xforms[i] = data.a[i].ComposeTransforms(data.b[i]); break;
+					case TransformOp::Inverse: xforms[i] = data.a[i].InverseTransform(); break;
+					default: vecs[i] = data.a[i].ApplyTransform(data.vecs[i]); break;
+				}
+			}
+		}
+	}
+
+	auto end = std::chrono::steady_clock::now();
+
+	// Keeps the results from being optimized away
+	volatile float sink = kernel ? batchXforms.GetStream(9)[0] + batchVecs.GetStream(0)[0]
+								 : xforms[0].translation.x + vecs[0].x;
+	(void)sink;
+
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+}
+
+uint64_t Median(std::vector<uint64_t> values) {
+	if (values.empty())
+		return 0;
+
+	std::sort(values.begin(), values.end());
+	return values[values.size() / 2];
+}
+
+double ToMilliseconds(uint64_t nanoseconds) {
+	return nanoseconds / 1000000.0;
+}
+
+void PrintUsage() {
+	std::cout << ProgramVersionLabel << " (benchmark)\n"
+			  << "Usage: nifopt_bench [options]\n"
+			  << "\n"
+			  << "Optimizes a generated corpus in memory and reports the median of all iterations.\n"
+			  << "Loading from disk is measured with memory-mapped and with stream-read files.\n"
+			  << "\n"
+			  << "Options:\n"
+			  << "  --scale <N>           Corpus size multiplier (default: 1)\n"
+			  << "  --iterations <N>      Number of measured runs (default: 5)\n"
+			  << "  --jobs <N>            Number of worker threads, 0 for all cores (default: 1)\n"
+			  << "  --seed <N>            Seed of the corpus generator (default: 1)\n"
+			  << "  --write-corpus <dir>  Keep the generated files in this folder (default: temporary)\n"
+			  << "  --json <path>         Write the results as JSON\n"
+			  << "  --help                Show this help\n";
+}
+} // namespace
+
+int main(int argc, char* argv[]) {
+	BenchmarkOptions options;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+
+		std::string name = arg;
+		if (name.size() > 1 && name[0] == '-')
+			name.erase(0, name[1] == '-' ? 2 : 1);
+
+		if (name == "h" || name == "help") {
+			PrintUsage();
+			return 0;
+		}
+
+		if (i + 1 >= argc) {
+			std::cerr << "Unknown option or missing value '" << arg << "'.\n";
+			PrintUsage();
+			return 1;
+		}
+
+		std::string value = argv[++i];
+		if (name == "scale")
+			options.scale = std::max(std::atoi(value.c_str()), 1);
+		else if (name == "iterations")
+			options.iterations = std::max(std::atoi(value.c_str()), 1);
+		else if (name == "jobs")
+			options.jobs = std::max(std::atoi(value.c_str()), 0);
+		else if (name == "seed")
+			options.seed = std::strtoull(value.c_str(), nullptr, 10);
+		else if (name == "write-corpus")
+			options.corpusFolder = value;
+		else if (name == "json")
+			options.jsonPath = value;
+		else {
+			std::cerr << "Unknown option '" << arg << "'.\n";
+			PrintUsage();
+			return 1;
+		}
+	}
+
+	std::vector<Category> corpus = GenerateCorpus(options.scale, options.seed);
+
+	// The corpus hash identifies runs that measured the same input
+	uint64_t corpusHash = CorpusVersion;
+	for (auto& category : corpus)
+		for (auto& file : category.files)
+			corpusHash = HashBytes(file.data.data(), file.data.size(), corpusHash);
+
+	// The loading benchmark needs the files on disk
+	bool temporaryCorpus = options.corpusFolder.empty();
+	if (temporaryCorpus)
+		options.corpusFolder = (std::filesystem::temp_directory_path() / "nifopt_bench_corpus").u8string();
+
+	if (!WriteCorpus(corpus, options.corpusFolder)) {
+		std::cerr << "Failed to write corpus to '" << options.corpusFolder << "'.\n";
+		return 1;
+	}
+
+	std::unique_ptr<ThreadPool> pool;
+	if (options.jobs != 1)
+		pool = std::make_unique<ThreadPool>(options.jobs);
+
+	size_t threadCount = pool ? pool->GetThreadCount() : 1;
+
+	std::printf("%s benchmark, corpus v%d, seed %llu, scale %d, %d iteration(s), %zu thread(s)\n",
+				ProgramVersionLabel,
+				CorpusVersion,
+				static_cast<unsigned long long>(options.seed),
+				options.scale,
+				options.iterations,
+				threadCount);
+	std::printf("Corpus hash: %016llx\n\n", static_cast<unsigned long long>(corpusHash));
+
+	std::printf("%-10s %5s %8s", "Category", "Files", "MB");
+	for (size_t p = static_cast<size_t>(Phase::Load); p <= static_cast<size_t>(Phase::Save); p++)
+		std::printf(" %11s", GetPhaseName(static_cast<Phase>(p)));
+	std::printf(" %10s %9s %8s %12s\n", "Wall ms", "Files/s", "MB/s", "Allocs/file");
+
+	std::string json = "{\"corpusVersion\":" + std::to_string(CorpusVersion);
+	char hashString[17];
+	std::snprintf(hashString, sizeof(hashString), "%016llx", static_cast<unsigned long long>(corpusHash));
+
+	json += ",\"corpusHash\":\"" + std::string(hashString) + "\"";
+	json += ",\"seed\":" + std::to_string(options.seed);
+	json += ",\"scale\":" + std::to_string(options.scale);
+	json += ",\"iterations\":" + std::to_string(options.iterations);
+	json += ",\"threads\":" + std::to_string(threadCount);
+	json += ",\"categories\":[";
+
+	bool anyFailed = false;
+
+	for (size_t c = 0; c < corpus.size(); c++) {
+		const Category& category = corpus[c];
+
+		size_t bytes = 0;
+		for (auto& file : category.files)
+			bytes += file.data.size();
+
+		// One warm-up run that isn't measured
+		RunCategory(category, pool.get());
+
+		std::vector<uint64_t> wall;
+		std::vector<uint64_t> phases[PhaseCount];
+		uint64_t allocations = 0;
+
+		for (int i = 0; i < options.iterations; i++) {
+			IterationResult iteration = RunCategory(category, pool.get());
+			if (iteration.failed > 0)
+				anyFailed = true;
+
+			wall.push_back(iteration.wallNanoseconds);
+			for (size_t p = 0; p < PhaseCount; p++)
+				phases[p].push_back(iteration.phaseNanoseconds[p]);
+
+			// Allocation counts don't vary between runs
+			allocations = iteration.allocations;
+		}
+
+		double fileCount = static_cast<double>(category.files.size());
+		double megabytes = bytes / (1024.0 * 1024.0);
+		double seconds = Median(wall) / 1e9;
+		double filesPerSecond = seconds > 0.0 ? fileCount / seconds : 0.0;
+		double megabytesPerSecond = seconds > 0.0 ? megabytes / seconds : 0.0;
+		double allocationsPerFile = fileCount > 0.0 ? allocations / fileCount : 0.0;
+
+		std::printf("%-10s %5zu %8.2f", category.name.c_str(), category.files.size(), megabytes);
+		for (size_t p = static_cast<size_t>(Phase::Load); p <= static_cast<size_t>(Phase::Save); p++)
+			std::printf(" %11.2f", ToMilliseconds(Median(phases[p])));
+		std::printf(" %10.2f %9.1f %8.2f %12.0f\n",
+					ToMilliseconds(Median(wall)),
+					filesPerSecond,
+					megabytesPerSecond,
+					allocationsPerFile);
+
+		json += c > 0 ? ",{" : "{";
+		json += "\"name\":\"" + category.name + "\"";
+		json += ",\"files\":" + std::to_string(category.files.size());
+		json += ",\"bytes\":" + std::to_string(bytes);
+		json += ",\"wallNs\":" + std::to_string(Median(wall));
+		json += ",\"allocations\":" + std::to_string(allocations);
+		json += ",\"phasesNs\":{";
+		for (size_t p = static_cast<size_t>(Phase::Load); p <= static_cast<size_t>(Phase::Save); p++) {
+			json += p > static_cast<size_t>(Phase::Load) ? ",\"" : "\"";
+			json += GetPhaseName(static_cast<Phase>(p));
+			json += "\":" + std::to_string(Median(phases[p]));
+		}
+		json += "}}";
+	}
+
+	json += "]";
+
+	std::printf("\nPhase columns are the median milliseconds summed over all files of a category.\n");
+
+	std::vector<std::string> corpusFiles;
+	size_t corpusBytes = 0;
+	for (auto& category : corpus) {
+		for (auto& file : category.files) {
+			corpusFiles.push_back(options.corpusFolder + "/" + file.name);
+			corpusBytes += file.data.size();
+		}
+	}
+
+	std::printf("\n%-10s %5s %8s %10s %8s\n", "Loading", "Files", "MB", "Wall ms", "MB/s");
+	json += ",\"loading\":[";
+
+	const bool loadModes[] = {true, false};
+	for (bool mapped : loadModes) {
+		const char* modeName = mapped ? "mapped" : "stream";
+
+		// One warm-up run that also brings the files into the file system cache
+		size_t failed = 0;
+		RunLoading(corpusFiles, mapped, failed);
+
+		std::vector<uint64_t> wall;
+		for (int i = 0; i < options.iterations; i++)
+			wall.push_back(RunLoading(corpusFiles, mapped, failed));
+
+		if (failed > 0)
+			anyFailed = true;
+
+		double megabytes = corpusBytes / (1024.0 * 1024.0);
+		double seconds = Median(wall) / 1e9;
+		double megabytesPerSecond = seconds > 0.0 ? megabytes / seconds : 0.0;
+
+		std::printf("%-10s %5zu %8.2f %10.2f %8.2f\n",
+					modeName,
+					corpusFiles.size(),
+					megabytes,
+					ToMilliseconds(Median(wall)),
+					megabytesPerSecond);
+
+		json += mapped ? "{" : ",{";
+		json += "\"mode\":\"" + std::string(modeName) + "\"";
+		json += ",\"files\":" + std::to_string(corpusFiles.size());
+		json += ",\"bytes\":" + std::to_string(corpusBytes);
+		json += ",\"wallNs\":" + std::to_string(Median(wall));
+		json += "}";
+	}
+
+	json += "]";
+
+	std::printf("\n%-10s %5s %10s %12s %12s %12s\n",
+				"Allocator",
+				"Files",
+				"Wall ms",
+				"Allocs/file",
+				"Heap/file",
+				"Max file MB");
+	json += ",\"allocators\":[";
+
+	const bool arenaModes[] = {false, true};
+	for (bool arenaAlloc : arenaModes) {
+		const char* modeName = arenaAlloc ? "arena" : "heap";
+
+		size_t fileCount = 0;
+		uint64_t allocations = 0;
+		uint64_t arenaAllocations = 0;
+		uint64_t maxFileBytes = 0;
+
+		for (auto& category : corpus)
+			RunCategory(category, pool.get(), arenaAlloc);
+
+		std::vector<uint64_t> wall;
+		for (int i = 0; i < options.iterations; i++) {
+			uint64_t wallNanoseconds = 0;
+			for (auto& category : corpus) {
+				IterationResult iteration = RunCategory(category, pool.get(), arenaAlloc);
+				if (iteration.failed > 0)
+					anyFailed = true;
+
+				wallNanoseconds += iteration.wallNanoseconds;
+
+				if (i == 0) {
+					fileCount += category.files.size();
+					allocations += iteration.allocations;
+					arenaAllocations += iteration.arenaAllocations;
+					maxFileBytes = std::max(maxFileBytes, iteration.maxFileBytes);
+				}
+			}
+
+			wall.push_back(wallNanoseconds);
+		}
+
+		double files = fileCount > 0 ? static_cast<double>(fileCount) : 1.0;
+
+		std::printf("%-10s %5zu %10.2f %12.0f %12.0f %12.2f\n",
+					modeName,
+					fileCount,
+					ToMilliseconds(Median(wall)),
+					allocations / files,
+					(allocations - arenaAllocations) / files,
+					maxFileBytes / (1024.0 * 1024.0));
+
+		json += arenaAlloc ? ",{" : "{";
+		json += "\"mode\":\"" + std::string(modeName) + "\"";
+		json += ",\"files\":" + std::to_string(fileCount);
+		json += ",\"wallNs\":" + std::to_string(Median(wall));
+		json += ",\"allocations\":" + std::to_string(allocations);
+		json += ",\"heapAllocations\":" + std::to_string(allocations - arenaAllocations);
+		json += ",\"maxFileBytes\":" + std::to_string(maxFileBytes);
+		json += "}";
+	}
+
+	json += "]";
+
+	std::printf("\nHeap/file counts the allocations that still went to the heap.\n");
+
+	// Same skeleton for every run of a seed
+	constexpr int SkeletonBones = 1000;
+	Random skeletonRng(options.seed);
+	std::vector<int> skeletonParents(SkeletonBones, -1);
+	std::vector<int> skeletonDepths(SkeletonBones, 1);
+	for (int i = 1; i < SkeletonBones; i++) {
+		skeletonParents[i] = skeletonRng.Int(8) == 0 ? skeletonRng.Int(i) : i - 1;
+		skeletonDepths[i] = skeletonDepths[skeletonParents[i]] + 1;
+	}
+
+	int skeletonDepth = *std::max_element(skeletonDepths.begin(), skeletonDepths.end());
+
+	std::printf("\n%-10s %5s %5s %10s %10s\n", "Skeleton", "Bones", "Depth", "Build ms", "Resolve ms");
+	json += ",\"skeleton\":[";
+
+	const bool linkOrders[] = {true, false};
+	for (bool parentsFirst : linkOrders) {
+		const char* orderName = parentsFirst ? "parents" : "children";
+
+		RunSkeleton(skeletonParents, parentsFirst, options.seed);
+
+		std::vector<uint64_t> build;
+		std::vector<uint64_t> resolve;
+		for (int i = 0; i < options.iterations; i++) {
+			SkeletonResult result = RunSkeleton(skeletonParents, parentsFirst, options.seed);
+			build.push_back(result.buildNanoseconds);
+			resolve.push_back(result.resolveNanoseconds);
+		}
+
+		std::printf("%-10s %5d %5d %10.3f %10.3f\n",
+					orderName,
+					SkeletonBones,
+					skeletonDepth,
+					ToMilliseconds(Median(build)),
+					ToMilliseconds(Median(resolve)));
+
+		json += parentsFirst ? "{" : ",{";
+		json += "\"order\":\"" + std::string(orderName) + "\"";
+		json += ",\"bones\":" + std::to_string(SkeletonBones);
+		json += ",\"depth\":" + std::to_string(skeletonDepth);
+		json += ",\"buildNs\":" + std::to_string(Median(build));
+		json += ",\"resolveNs\":" + std::to_string(Median(resolve));
+		json += "}";
+	}
+
+	json += "]";
+
+	std::printf("\nSkeleton rows link the bones parents first or children first.\n");
+
+	// Whole-skeleton sized batches of random transforms
+	constexpr int TransformCount = 4096;
+	constexpr int TransformRounds = 100;
+	TransformData transformData = GenerateTransforms(TransformCount, options.seed);
+	const TransformKernel kernels[] = {TransformKernel::Scalar, TransformKernel::SSE2, TransformKernel::AVX2};
+
+	std::printf("\n%-10s %6s %10s", "Transforms", "Count", "MatXform");
+	for (TransformKernel kernel : kernels)
+		std::printf(" %10s", TransformBatch::GetKernelName(kernel));
+	std::printf("\n");
+	json += ",\"transforms\":[";
+
+	for (size_t o = 0; o < static_cast<size_t>(TransformOp::Count); o++) {
+		TransformOp op = static_cast<TransformOp>(o);
+
+		// nullptr for the MatTransform functions, then the kernels
+		std::vector<const TransformKernel*> runs = {nullptr};
+		for (const TransformKernel& kernel : kernels)
+			runs.push_back(TransformBatch::IsSupported(kernel) ? &kernel : nullptr);
+
+		std::printf("%-10s %6d", GetTransformOpName(op), TransformCount);
+		json += o > 0 ? ",{" : "{";
+		json += "\"op\":\"" + std::string(GetTransformOpName(op)) + "\"";
+		json += ",\"count\":" + std::to_string(TransformCount);
+
+		for (size_t r = 0; r < runs.size(); r++) {
+			if (r > 0 && !runs[r]) {
+				std::printf(" %10s", "-");
+				continue;
+			}
+
+			RunTransforms(transformData, op, runs[r], 1);
+
+			std::vector<uint64_t> wall;
+			for (int i = 0; i < options.iterations; i++)
+				wall.push_back(RunTransforms(transformData, op, runs[r], TransformRounds));
+
+			double nsPerTransform = static_cast<double>(Median(wall)) / (TransformCount * TransformRounds);
+			std::printf(" %10.2f", nsPerTransform);
+
+			const char* runName = runs[r] ? TransformBatch::GetKernelName(*runs[r]) : "MatTransform";
+			json += ",\"" + std::string(runName) + "Ns\":" + std::to_string(Median(wall));
+		}
+
+		std::printf("\n");
+		json += ",\"rounds\":" + std::to_string(TransformRounds) + "}";
+	}
+
+	json += "]}\n";
+
+	std::printf("\nTransform columns are nanoseconds per transform, MatXform is MatTransform one by one.\n");
+
+	if (temporaryCorpus) {
+		std::error_code ec;
+		std::filesystem::remove_all(std::filesystem::u8path(options.corpusFolder), ec);
+	}
+
+	if (anyFailed)
+		std::cerr << "Some files failed to optimize, results aren't comparable.\n";
+
+	if (!options.jsonPath.empty() && !PlatformUtil::WriteFile(options.jsonPath, json.data(), json.size())) {
+		std::cerr << "Failed to write '" << options.jsonPath << "'.\n";
+		return 1;
+	}
+
+	return anyFailed ? 1 : 0;
+}
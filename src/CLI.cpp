@@ -0,0 +1,261 @@
+/*
+SSE NIF Optimizer
+See the included LICENSE file
+*/
+
+#include "OptimizerCore.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+
+namespace {
+void PrintUsage() {
+	std::cout << ProgramVersionLabel << " (command line)\n"
+			  << "Usage: nifopt [options] <paths to files and/or directories>\n"
+			  << "\n"
+			  << "Options:\n"
+			  << "  --opt <SSE|LE>     Optimize for given target (default: SSE)\n"
+			  << "  --log <path>       Path to log file\n"
+			  << "  --json-log <path>  Path to JSON Lines log file with one record per file\n"
+			  << "  --trace <path>     Write a Chrome trace (chrome://tracing, Perfetto) of the run\n"
+			  << "  --recursive        Recursively parse all directories\n"
+			  << "  --headparts        Optimize files as headparts\n"
+			  << "  --skeleton <path>  Reference skeleton NIF for the bones of skinned shapes\n"
+			  << "  --fast-skin-bounds Approximate the bone bounds of skinned shapes, faster but less tight\n"
+			  << "  --jobs <N>         Number of worker threads (default: all cores)\n"
+			  << "  --pipeline         Read and write files in the background while optimizing\n"
+			  << "  --no-mmap          Read files with streams instead of mapping them into memory\n"
+			  << "  --arena            Build each file in a per-thread arena that's freed in bulk\n"
+			  << "  --sync <policy>    Flush saved files to disk: none, each or batch (default: none)\n"
+			  << "  --sync-batch <N>   Number of files flushed together by --sync batch (default: 64)\n"
+			  << "  --manifest <path>  Skip files that are unchanged since the last run with this manifest\n"
+			  << "  --force            Also process files this version already optimized with these options\n"
+			  << "  --stats            Print per-phase timings and the slowest files after the run\n"
+			  << "  --slowest <N>      Number of slowest files listed by --stats (default: 10)\n"
+			  << "  --progress         Show a progress line with the estimated time left\n"
+			  << "  --help             Show this help\n";
+}
+} // namespace
+
+int main(int argc, char* argv[]) {
+	OptimizerOptions options;
+	options.recursive = false;
+
+	std::vector<std::string> paths;
+	bool showProgress = false;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+
+		// Accept both "-option" and "--option"
+		std::string name = arg;
+		if (name.size() > 1 && name[0] == '-')
+			name.erase(0, name[1] == '-' ? 2 : 1);
+		else
+			name.clear();
+
+		auto nextValue = [&](std::string& value) {
+			if (i + 1 >= argc) {
+				std::cerr << "Missing value for option '" << arg << "'.\n";
+				return false;
+			}
+
+			value = argv[++i];
+			return true;
+		};
+
+		std::string value;
+		if (name.empty()) {
+			paths.push_back(arg);
+		}
+		else if (name == "h" || name == "help") {
+			PrintUsage();
+			return 0;
+		}
+		else if (name == "opt" || name == "optimize") {
+			if (!nextValue(value))
+				return 1;
+			options.targetGame = value == "LE" ? TargetGame::LE : TargetGame::SSE;
+		}
+		else if (name == "log") {
+			if (!nextValue(value))
+				return 1;
+			options.logFilePath = value;
+		}
+		else if (name == "trace") {
+			if (!nextValue(value))
+				return 1;
+			options.traceFilePath = value;
+		}
+		else if (name == "json-log" || name == "jsonlog") {
+			if (!nextValue(value))
+				return 1;
+			options.jsonLogFilePath = value;
+		}
+		else if (name == "recursive") {
+			options.recursive = true;
+		}
+		else if (name == "headparts") {
+			options.headParts = true;
+		}
+		else if (name == "skeleton") {
+			if (!nextValue(value))
+				return 1;
+			options.skeletonPath = value;
+		}
+		else if (name == "fast-skin-bounds") {
+			options.fastSkinBounds = true;
+		}
+		else if (name == "jobs") {
+			if (!nextValue(value))
+				return 1;
+			options.jobs = std::atoi(value.c_str());
+		}
+		else if (name == "pipeline") {
+			options.pipeline = true;
+		}
+		else if (name == "no-mmap") {
+			options.memoryMap = false;
+		}
+		else if (name == "arena") {
+			options.arenaAlloc = true;
+		}
+		else if (name == "sync") {
+			if (!nextValue(value))
+				return 1;
+
+			if (value == "none") {
+				options.syncPolicy = SyncPolicy::None;
+			}
+			else if (value == "each") {
+				options.syncPolicy = SyncPolicy::EachFile;
+			}
+			else if (value == "batch") {
+				options.syncPolicy = SyncPolicy::Batched;
+			}
+			else {
+				std::cerr << "Unknown sync policy '" << value << "'.\n";
+				PrintUsage();
+				return 1;
+			}
+		}
+		else if (name == "sync-batch") {
+			if (!nextValue(value))
+				return 1;
+			options.syncBatchSize = static_cast<size_t>(std::max(std::atoi(value.c_str()), 1));
+		}
+		else if (name == "force") {
+			options.skipOptimized = false;
+		}
+		else if (name == "stats") {
+			options.reportStats = true;
+		}
+		else if (name == "progress") {
+			showProgress = true;
+		}
+		else if (name == "slowest") {
+			if (!nextValue(value))
+				return 1;
+			options.slowestFiles = static_cast<size_t>(std::max(std::atoi(value.c_str()), 0));
+		}
+		else if (name == "manifest") {
+			if (!nextValue(value))
+				return 1;
+			options.manifestPath = value;
+		}
+		else {
+			std::cerr << "Unknown option '" << arg << "'.\n";
+			PrintUsage();
+			return 1;
+		}
+	}
+
+	if (paths.empty()) {
+		PrintUsage();
+		return 1;
+	}
+
+	for (auto& path : paths) {
+		std::error_code ec;
+		std::filesystem::path fsPath = std::filesystem::u8path(path);
+
+		if (std::filesystem::is_regular_file(fsPath, ec)) {
+			if (OptimizerCore::IsOptimizableFile(path))
+				options.files.push_back(path);
+		}
+		else if (std::filesystem::is_directory(fsPath, ec)) {
+			options.folders.push_back(path);
+		}
+		else {
+			std::cerr << "Path not found: '" << path << "'.\n";
+		}
+	}
+
+	size_t found = 0;
+	size_t saved = 0;
+	size_t identical = 0;
+	size_t skipped = 0;
+	size_t failed = 0;
+
+	// The progress line is rewritten in place and cleared before any other output
+	size_t progressLength = 0;
+	auto clearProgress = [&]() {
+		if (progressLength > 0)
+			std::cerr << '\r' << std::string(progressLength, ' ') << '\r';
+		progressLength = 0;
+	};
+
+	OptimizerCore core;
+	core.progressCallback = [&](const RunProgress& progress, const std::string& file, const FileResult& result) {
+		clearProgress();
+
+		// Second report of a file that was counted as saved before
+		if (result.replaceFailed) {
+			saved--;
+			failed++;
+			std::cerr << "Failed to replace '" << file << "'.\n";
+			return;
+		}
+
+		found++;
+
+		if (result.status == FileStatus::Saved) {
+			saved++;
+		}
+		else if (result.status == FileStatus::Identical) {
+			identical++;
+		}
+		else if (result.status == FileStatus::Unchanged || result.status == FileStatus::AlreadyOptimized) {
+			skipped++;
+		}
+		else {
+			failed++;
+			std::cerr << "Failed to " << (result.status == FileStatus::LoadFailed ? "load" : "save") << " '"
+					  << file << "'.\n";
+		}
+
+		if (showProgress) {
+			char percent[16];
+			std::snprintf(percent, sizeof(percent), "[%5.1f%%] ", progress.GetPercent());
+
+			std::string line = percent + std::to_string(progress.filesDone) + "/"
+							   + std::to_string(progress.fileCount) + " file(s), " + progress.GetStatusText();
+			std::cerr << line << std::flush;
+			progressLength = line.size();
+		}
+	};
+
+	core.Optimize(options);
+	clearProgress();
+
+	std::cout << found << " file(s) processed, " << saved << " saved, " << identical
+			  << " not rewritten (identical), " << skipped << " skipped, " << failed << " failed.\n";
+
+	if (options.reportStats)
+		std::cout << "\n" << core.GetRunStats().FormatReport(options.slowestFiles);
+
+	return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,75 @@
+/*
+SSE NIF Optimizer
+See the included LICENSE file
+*/
+
+// Global operator new/delete that count the allocations of every thread and serve them from its arena
+// while one is active. Only linked into the command line tools, every allocation pays for the checks.
+
+#include "Arena.hpp"
+#include "Instrumentation.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+#if defined(_WIN32)
+#include <malloc.h>
+#define HEAP_BLOCK_SIZE(ptr) _msize(ptr)
+#elif defined(__APPLE__)
+#include <malloc/malloc.h>
+#define HEAP_BLOCK_SIZE(ptr) malloc_size(ptr)
+#else
+#include <malloc.h>
+#define HEAP_BLOCK_SIZE(ptr) malloc_usable_size(ptr)
+#endif
+
+using CountingAllocator::threadAllocs;
+
+namespace {
+struct LinkedFlag {
+	LinkedFlag() { CountingAllocator::linked = true; }
+} linkedFlag;
+} // namespace
+
+// The default array and nothrow forms forward to these.
+// Aligned allocations bypass them and aren't counted.
+void* operator new(size_t size) {
+	AllocCounters& allocs = threadAllocs;
+
+	size_t blockSize = 0;
+	void* ptr = Arena::Allocate(size, blockSize);
+	if (ptr) {
+		allocs.arenaAllocations++;
+	}
+	else {
+		ptr = std::malloc(size > 0 ? size : 1);
+		if (!ptr)
+			throw std::bad_alloc();
+
+		blockSize = HEAP_BLOCK_SIZE(ptr);
+	}
+
+	allocs.currentBytes += static_cast<int64_t>(blockSize);
+	allocs.peakBytes = std::max(allocs.peakBytes, allocs.currentBytes);
+	allocs.allocations++;
+	return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+	if (!ptr)
+		return;
+
+	size_t blockSize = 0;
+	if (Arena::Free(ptr, blockSize)) {
+		threadAllocs.currentBytes -= static_cast<int64_t>(blockSize);
+		return;
+	}
+
+	threadAllocs.currentBytes -= static_cast<int64_t>(HEAP_BLOCK_SIZE(ptr));
+	std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+	operator delete(ptr);
+}
@@ -0,0 +1,130 @@
+/*
+SSE NIF Optimizer
+See the included LICENSE file
+*/
+
+#include "DirectoryWalker.hpp"
+
+#include <algorithm>
+
+namespace fs = std::filesystem;
+
+DirectoryWalker::DirectoryWalker(size_t threadCount)
+	: threadCount(threadCount) {
+	// Reading directories mostly waits for the file system, so more threads than cores pay off
+	if (this->threadCount == 0)
+		this->threadCount = std::clamp<size_t>(std::thread::hardware_concurrency(), 4, 16);
+}
+
+DirectoryWalker::~DirectoryWalker() {
+	Stop();
+	Wait();
+}
+
+void DirectoryWalker::Start(const std::vector<std::string>& folders,
+							bool recursive,
+							FileCallback onFile,
+							std::function<void()> onFinished) {
+	Wait();
+
+	this->recursive = recursive;
+	this->onFile = std::move(onFile);
+	this->onFinished = std::move(onFinished);
+
+	stopping = false;
+	busyThreads = 0;
+	pendingDirs.clear();
+
+	for (auto& folder : folders)
+		pendingDirs.push_back(fs::u8path(folder));
+
+	// Reversed, so that the folders are searched in the given order
+	std::reverse(pendingDirs.begin(), pendingDirs.end());
+
+	runningThreads = threadCount;
+	for (size_t i = 0; i < threadCount; i++)
+		threads.emplace_back(&DirectoryWalker::WalkerLoop, this);
+}
+
+void DirectoryWalker::Stop() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+
+	wakeCondition.notify_all();
+}
+
+void DirectoryWalker::Wait() {
+	for (auto& thread : threads)
+		thread.join();
+
+	threads.clear();
+}
+
+void DirectoryWalker::Walk(const std::vector<std::string>& folders, bool recursive, const FileCallback& onFile) {
+	// Reporting is serialized for the caller
+	std::mutex callbackMutex;
+
+	DirectoryWalker walker;
+	walker.Start(folders, recursive, [&](const std::string& file, uint64_t fileSize) {
+		std::lock_guard<std::mutex> lock(callbackMutex);
+		onFile(file, fileSize);
+	});
+	walker.Wait();
+}
+
+void DirectoryWalker::WalkerLoop() {
+	std::vector<fs::path> subDirs;
+	std::unique_lock<std::mutex> lock(mutex);
+
+	for (;;) {
+		// The search is over when no directories are left and nobody is reading one that could add more
+		wakeCondition.wait(lock, [this] { return stopping || !pendingDirs.empty() || busyThreads == 0; });
+		if (stopping || pendingDirs.empty())
+			break;
+
+		// Depth-first keeps the list of pending directories short
+		fs::path dir = std::move(pendingDirs.back());
+		pendingDirs.pop_back();
+		busyThreads++;
+
+		lock.unlock();
+		subDirs.clear();
+		ReadDirectory(dir, subDirs);
+		lock.lock();
+
+		busyThreads--;
+		for (auto it = subDirs.rbegin(); it != subDirs.rend(); ++it)
+			pendingDirs.push_back(std::move(*it));
+
+		wakeCondition.notify_all();
+	}
+
+	bool lastThread = --runningThreads == 0;
+	lock.unlock();
+	wakeCondition.notify_all();
+
+	if (lastThread && onFinished)
+		onFinished();
+}
+
+void DirectoryWalker::ReadDirectory(const fs::path& dir, std::vector<fs::path>& subDirs) {
+	std::error_code ec;
+	fs::directory_iterator it(dir, fs::directory_options::skip_permission_denied, ec);
+
+	// The entry types (and on Windows the sizes) come with the directory listing, no extra stat per file needed
+	for (fs::directory_iterator end; !ec && it != end && !stopping; it.increment(ec)) {
+		std::error_code entryEc;
+
+		if (it->is_directory(entryEc)) {
+			// Like recursive_directory_iterator, directory symlinks aren't followed
+			if (recursive && !it->is_symlink(entryEc))
+				subDirs.push_back(it->path());
+		}
+		else if (it->is_regular_file(entryEc)) {
+			uint64_t fileSize = it->file_size(entryEc);
+			onFile(it->path().u8string(), entryEc ? 0 : fileSize);
+		}
+	}
+}
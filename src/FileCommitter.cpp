@@ -0,0 +1,111 @@
+/*
+SSE NIF Optimizer
+See the included LICENSE file
+*/
+
+#include "FileCommitter.hpp"
+#include "PlatformUtil.hpp"
+
+#include <filesystem>
+#include <set>
+
+FileCommitter::FileCommitter(SyncPolicy policy, size_t batchSize)
+	: policy(policy)
+	, batchSize(batchSize > 0 ? batchSize : 1) {}
+
+FileCommitter::~FileCommitter() {
+	Commit();
+}
+
+bool FileCommitter::Write(const std::string& fileName, const char* data, size_t size) {
+	// A rename would replace a link with a regular file
+	std::error_code ec;
+	std::filesystem::path path = std::filesystem::u8path(fileName);
+	std::filesystem::path target = std::filesystem::canonical(path, ec);
+	if (ec)
+		target = path;
+
+	std::string targetFileName = target.u8string();
+	uintmax_t linkCount = std::filesystem::hard_link_count(target, ec);
+	if (!ec && linkCount > 1) {
+		// Not atomic, so it's always flushed unless syncing is off
+		return PlatformUtil::WriteNewFile(targetFileName, data, size, policy != SyncPolicy::None);
+	}
+
+	std::string tempFileName = PlatformUtil::GetTempFileName(targetFileName);
+
+	bool syncEach = policy == SyncPolicy::EachFile;
+	if (!PlatformUtil::WriteNewFile(tempFileName, data, size, syncEach)) {
+		std::filesystem::remove(std::filesystem::u8path(tempFileName), ec);
+		return false;
+	}
+
+	if (policy != SyncPolicy::Batched) {
+		if (PlatformUtil::RenameFile(tempFileName, targetFileName, syncEach))
+			return true;
+
+		std::filesystem::remove(std::filesystem::u8path(tempFileName), ec);
+		return false;
+	}
+
+	// The thread that fills up a batch commits it
+	std::vector<PendingFile> batch;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		pending.push_back({fileName, targetFileName, tempFileName});
+		if (pending.size() >= batchSize)
+			batch.swap(pending);
+	}
+
+	if (!batch.empty())
+		CommitBatch(batch);
+
+	return true;
+}
+
+std::vector<std::string> FileCommitter::Commit() {
+	std::vector<PendingFile> batch;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		batch.swap(pending);
+	}
+
+	if (!batch.empty())
+		CommitBatch(batch);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	std::vector<std::string> result;
+	result.swap(failed);
+	return result;
+}
+
+void FileCommitter::CommitBatch(const std::vector<PendingFile>& batch) {
+	std::vector<std::string> batchFailed;
+	std::set<std::string> folders;
+
+	// All contents reach the disk before any file is replaced, then each folder is flushed once
+	std::vector<bool> synced(batch.size());
+	for (size_t i = 0; i < batch.size(); i++)
+		synced[i] = PlatformUtil::SyncFile(batch[i].tempFileName);
+
+	for (size_t i = 0; i < batch.size(); i++) {
+		const PendingFile& file = batch[i];
+
+		if (synced[i] && PlatformUtil::RenameFile(file.tempFileName, file.targetFileName)) {
+			folders.insert(std::filesystem::u8path(file.targetFileName).parent_path().u8string());
+		}
+		else {
+			std::error_code ec;
+			std::filesystem::remove(std::filesystem::u8path(file.tempFileName), ec);
+			batchFailed.push_back(file.fileName);
+		}
+	}
+
+	for (auto& folder : folders)
+		PlatformUtil::SyncDirectory(folder);
+
+	if (!batchFailed.empty()) {
+		std::lock_guard<std::mutex> lock(mutex);
+		failed.insert(failed.end(), batchFailed.begin(), batchFailed.end());
+	}
+}
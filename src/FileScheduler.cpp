@@ -0,0 +1,61 @@
+/*
+SSE NIF Optimizer
+See the included LICENSE file
+*/
+
+#include "FileScheduler.hpp"
+
+#include <algorithm>
+
+namespace {
+bool IsLessUrgent(const FileScheduler::Entry& a, const FileScheduler::Entry& b) {
+	if (a.size != b.size)
+		return a.size < b.size;
+
+	return a.order > b.order;
+}
+} // namespace
+
+void FileScheduler::Push(const std::string& file, uint64_t size) {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		heap.push_back({file, size, nextOrder++});
+		std::push_heap(heap.begin(), heap.end(), IsLessUrgent);
+	}
+
+	notEmpty.notify_one();
+}
+
+bool FileScheduler::Pop(Entry& entry) {
+	std::unique_lock<std::mutex> lock(mutex);
+	notEmpty.wait(lock, [&]() { return closed || !heap.empty(); });
+	if (heap.empty())
+		return false;
+
+	PopLargest(entry);
+	return true;
+}
+
+bool FileScheduler::TryPop(Entry& entry) {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (heap.empty())
+		return false;
+
+	PopLargest(entry);
+	return true;
+}
+
+void FileScheduler::Close() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		closed = true;
+	}
+
+	notEmpty.notify_all();
+}
+
+void FileScheduler::PopLargest(Entry& entry) {
+	std::pop_heap(heap.begin(), heap.end(), IsLessUrgent);
+	entry = std::move(heap.back());
+	heap.pop_back();
+}
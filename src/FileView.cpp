@@ -0,0 +1,126 @@
+/*
+SSE NIF Optimizer
+See the included LICENSE file
+*/
+
+#include "FileView.hpp"
+#include "PlatformUtil.hpp"
+
+#include <algorithm>
+#include <fstream>
+
+#ifndef _WINDOWS
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool FileView::Open(const std::string& fileName, bool allowMapping, size_t maxReadBytes) {
+	Close();
+
+	if (allowMapping && Map(fileName))
+		return true;
+
+	return Read(fileName, maxReadBytes);
+}
+
+void FileView::Close() {
+	if (mapping) {
+#ifdef _WINDOWS
+		UnmapViewOfFile(mapping);
+#else
+		munmap(mapping, size);
+#endif
+		mapping = nullptr;
+	}
+
+	buffer = std::vector<char>();
+	data = nullptr;
+	size = 0;
+}
+
+bool FileView::Map(const std::string& fileName) {
+#ifdef _WINDOWS
+	HANDLE file = CreateFileW(PlatformUtil::MultiByteToWideUTF8(fileName).c_str(),
+							  GENERIC_READ,
+							  FILE_SHARE_READ,
+							  nullptr,
+							  OPEN_EXISTING,
+							  FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+							  nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	// Empty files can't be mapped
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart <= 0
+		|| static_cast<uint64_t>(fileSize.QuadPart) > SIZE_MAX) {
+		CloseHandle(file);
+		return false;
+	}
+
+	HANDLE fileMapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (fileMapping)
+		mapping = MapViewOfFile(fileMapping, FILE_MAP_READ, 0, 0, 0);
+
+	// The view keeps the file mapping alive
+	if (fileMapping)
+		CloseHandle(fileMapping);
+	CloseHandle(file);
+
+	if (!mapping)
+		return false;
+
+	size = static_cast<size_t>(fileSize.QuadPart);
+#else
+	int file = open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+	if (file < 0)
+		return false;
+
+	// Empty files can't be mapped
+	struct stat fileStat;
+	if (fstat(file, &fileStat) != 0 || !S_ISREG(fileStat.st_mode) || fileStat.st_size <= 0) {
+		close(file);
+		return false;
+	}
+
+	size_t fileSize = static_cast<size_t>(fileStat.st_size);
+	void* view = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, file, 0);
+	close(file);
+
+	if (view == MAP_FAILED)
+		return false;
+
+	// NIFs are parsed front to back
+	posix_madvise(view, fileSize, POSIX_MADV_SEQUENTIAL);
+
+	mapping = view;
+	size = fileSize;
+#endif
+
+	data = static_cast<const char*>(mapping);
+	return true;
+}
+
+bool FileView::Read(const std::string& fileName, size_t maxReadBytes) {
+	std::fstream file;
+	PlatformUtil::OpenFileStream(file, fileName, std::ios::in | std::ios::binary | std::ios::ate);
+	if (!file)
+		return false;
+
+	std::streamoff fileSize = file.tellg();
+	if (fileSize < 0)
+		return false;
+
+	buffer.resize(static_cast<size_t>(std::min<uint64_t>(static_cast<uint64_t>(fileSize), maxReadBytes)));
+	file.seekg(0);
+	if (!file.read(buffer.data(), static_cast<std::streamsize>(buffer.size()))) {
+		buffer = std::vector<char>();
+		return false;
+	}
+
+	data = buffer.data();
+	size = buffer.size();
+	return true;
+}
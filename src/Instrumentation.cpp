@@ -0,0 +1,261 @@
+/*
+SSE NIF Optimizer
+See the included LICENSE file
+*/
+
+#include "Instrumentation.hpp"
+#include "Trace.hpp"
+
+#include <algorithm>
+#include <cstdio>
+
+thread_local AllocCounters CountingAllocator::threadAllocs{};
+bool CountingAllocator::linked = false;
+
+namespace {
+double ToMilliseconds(uint64_t nanoseconds) {
+	return nanoseconds / 1000000.0;
+}
+
+double ToMegabytes(uint64_t bytes) {
+	return bytes / (1024.0 * 1024.0);
+}
+
+// Nearest-rank percentile of a sorted list
+uint64_t Percentile(const std::vector<uint64_t>& sorted, double percent) {
+	if (sorted.empty())
+		return 0;
+
+	size_t rank = static_cast<size_t>(percent / 100.0 * sorted.size() + 0.999999);
+	return sorted[std::min(std::max<size_t>(rank, 1), sorted.size()) - 1];
+}
+} // namespace
+
+const char* GetPhaseName(Phase phase) {
+	switch (phase) {
+		case Phase::Read: return "Read";
+		case Phase::Load: return "Load";
+		case Phase::OptimizeFor: return "OptimizeFor";
+		case Phase::SkinLoad: return "Skin Load";
+		case Phase::SkinWrite: return "Skin Write";
+		case Phase::Normals: return "Normals";
+		case Phase::Save: return "Save";
+		case Phase::Write: return "Write";
+		case Phase::Count: break;
+	}
+
+	return "Unknown";
+}
+
+uint64_t FileStats::GetTotalNanoseconds() const {
+	uint64_t total = 0;
+	for (auto& phase : phases)
+		total += phase.nanoseconds;
+
+	return total;
+}
+
+AllocCounters GetThreadAllocCounters() {
+	return CountingAllocator::threadAllocs;
+}
+
+bool IsCountingAllocatorLinked() {
+	return CountingAllocator::linked;
+}
+
+PhaseTimer::PhaseTimer(FileStats& stats, Phase phase)
+	: target(&stats[phase])
+	, phase(phase) {
+	AllocCounters& allocs = CountingAllocator::threadAllocs;
+	startBytes = allocs.currentBytes;
+	startAllocations = allocs.allocations;
+	startArenaAllocations = allocs.arenaAllocations;
+
+	// Track the peak of this phase separately and merge it back into the outer one when done
+	outerPeakBytes = allocs.peakBytes;
+	allocs.peakBytes = allocs.currentBytes;
+
+	start = std::chrono::steady_clock::now();
+}
+
+void PhaseTimer::Stop() {
+	if (!target)
+		return;
+
+	auto end = std::chrono::steady_clock::now();
+	Trace::AddSpan(GetPhaseName(phase), "phase", start, end);
+
+	auto elapsed = end - start;
+	target->nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+
+	AllocCounters& allocs = CountingAllocator::threadAllocs;
+	uint64_t peak = static_cast<uint64_t>(std::max<int64_t>(allocs.peakBytes - startBytes, 0));
+	target->peakBytes = std::max(target->peakBytes, peak);
+	target->allocations += allocs.allocations - startAllocations;
+	target->arenaAllocations += allocs.arenaAllocations - startArenaAllocations;
+
+	allocs.peakBytes = std::max(allocs.peakBytes, outerPeakBytes);
+	target = nullptr;
+}
+
+void RunStats::Add(const std::string& file, const FileStats& stats) {
+	if (stats.GetTotalNanoseconds() > 0)
+		files.emplace_back(file, stats);
+}
+
+std::string RunStats::FormatReport(size_t slowestCount, const char* lineEnd) const {
+	std::string report;
+	char line[512];
+
+	auto addLine = [&](const char* text) {
+		report += text;
+		report += lineEnd;
+	};
+
+	uint64_t bytesRead = 0;
+	uint64_t bytesWritten = 0;
+	uint64_t blockCount = 0;
+	uint64_t totalNanoseconds = 0;
+	uint64_t totalAllocations = 0;
+	uint64_t arenaAllocations = 0;
+	uint64_t maxArenaBytes = 0;
+
+	for (auto& file : files) {
+		bytesRead += file.second.bytesRead;
+		bytesWritten += file.second.bytesWritten;
+		blockCount += file.second.blockCount;
+		totalNanoseconds += file.second.GetTotalNanoseconds();
+		maxArenaBytes = std::max(maxArenaBytes, file.second.arenaBytes);
+
+		for (auto& phase : file.second.phases) {
+			totalAllocations += phase.allocations;
+			arenaAllocations += phase.arenaAllocations;
+		}
+	}
+
+	std::snprintf(line, sizeof(line), "[INFO] Performance report (%zu file(s) processed):", files.size());
+	addLine(line);
+
+	std::snprintf(line,
+				  sizeof(line),
+				  "- Read: %.2f MB, Written: %.2f MB, Blocks: %llu, Total: %.1f ms",
+				  ToMegabytes(bytesRead),
+				  ToMegabytes(bytesWritten),
+				  static_cast<unsigned long long>(blockCount),
+				  ToMilliseconds(totalNanoseconds));
+	addLine(line);
+
+	if (arenaAllocations > 0) {
+		std::snprintf(line,
+					  sizeof(line),
+					  "- Arena: %llu of %llu allocations, max %.2f MB per file, %.2f MB pinned",
+					  static_cast<unsigned long long>(arenaAllocations),
+					  static_cast<unsigned long long>(totalAllocations),
+					  ToMegabytes(maxArenaBytes),
+					  ToMegabytes(arenaPinnedBytes));
+		addLine(line);
+	}
+
+	addLine("");
+
+	std::snprintf(line,
+				  sizeof(line),
+				  "%-12s %6s %11s %9s %9s %9s %9s %13s %12s",
+				  "Phase",
+				  "Files",
+				  "Total ms",
+				  "p50 ms",
+				  "p90 ms",
+				  "p99 ms",
+				  "Max ms",
+				  "Max peak MB",
+				  "Allocations");
+	addLine(line);
+
+	std::vector<uint64_t> times;
+	times.reserve(files.size());
+
+	for (size_t p = 0; p < PhaseCount; p++) {
+		times.clear();
+
+		uint64_t total = 0;
+		uint64_t maxPeak = 0;
+		uint64_t allocations = 0;
+
+		for (auto& file : files) {
+			const PhaseStats& phase = file.second.phases[p];
+			if (phase.nanoseconds == 0)
+				continue;
+
+			times.push_back(phase.nanoseconds);
+			total += phase.nanoseconds;
+			maxPeak = std::max(maxPeak, phase.peakBytes);
+			allocations += phase.allocations;
+		}
+
+		if (times.empty())
+			continue;
+
+		std::sort(times.begin(), times.end());
+
+		std::snprintf(line,
+					  sizeof(line),
+					  "%-12s %6zu %11.1f %9.2f %9.2f %9.2f %9.2f %13.2f %12llu",
+					  GetPhaseName(static_cast<Phase>(p)),
+					  times.size(),
+					  ToMilliseconds(total),
+					  ToMilliseconds(Percentile(times, 50.0)),
+					  ToMilliseconds(Percentile(times, 90.0)),
+					  ToMilliseconds(Percentile(times, 99.0)),
+					  ToMilliseconds(times.back()),
+					  ToMegabytes(maxPeak),
+					  static_cast<unsigned long long>(allocations));
+		addLine(line);
+	}
+
+	if (slowestCount == 0 || files.empty())
+		return report;
+
+	std::vector<const std::pair<std::string, FileStats>*> slowest;
+	slowest.reserve(files.size());
+	for (auto& file : files)
+		slowest.push_back(&file);
+
+	size_t count = std::min(slowestCount, slowest.size());
+	std::partial_sort(slowest.begin(), slowest.begin() + count, slowest.end(), [](auto a, auto b) {
+		return a->second.GetTotalNanoseconds() > b->second.GetTotalNanoseconds();
+	});
+
+	addLine("");
+	std::snprintf(line, sizeof(line), "[INFO] Slowest %zu file(s):", count);
+	addLine(line);
+
+	for (size_t i = 0; i < count; i++) {
+		const FileStats& stats = slowest[i]->second;
+
+		std::snprintf(line,
+					  sizeof(line),
+					  "- %.1f ms, %.2f MB, %u blocks: '",
+					  ToMilliseconds(stats.GetTotalNanoseconds()),
+					  ToMegabytes(stats.bytesRead),
+					  stats.blockCount);
+		report += line + slowest[i]->first + "'" + lineEnd;
+
+		std::string phases = " ";
+		for (size_t p = 0; p < PhaseCount; p++) {
+			if (stats.phases[p].nanoseconds == 0)
+				continue;
+
+			std::snprintf(line,
+						  sizeof(line),
+						  " %s %.1f ms (peak %.2f MB)",
+						  GetPhaseName(static_cast<Phase>(p)),
+						  ToMilliseconds(stats.phases[p].nanoseconds),
+						  ToMegabytes(stats.phases[p].peakBytes));
+			phases += line;
+		}
+		addLine(phases.c_str());
+	}
+
+	return report;
+}
@@ -0,0 +1,179 @@
+/*
+SSE NIF Optimizer
+See the included LICENSE file
+*/
+
+#include "Manifest.hpp"
+#include "Hash.hpp"
+#include "OptimizerCore.hpp"
+#include "PlatformUtil.hpp"
+
+#include <cstdlib>
+#include <filesystem>
+
+namespace {
+constexpr auto ManifestHeader = "# SSE NIF Optimizer manifest v1";
+}
+
+bool Manifest::Load(const std::string& fileName) {
+	entries.clear();
+
+	std::fstream file;
+	PlatformUtil::OpenFileStream(file, fileName, std::ios::in | std::ios::binary);
+	if (!file)
+		return false;
+
+	std::string line;
+	if (!std::getline(file, line) || line != ManifestHeader)
+		return false;
+
+	// <content hash> <size> <modified time> <options fingerprint> <tool version> <path>, tab-separated
+	while (std::getline(file, line)) {
+		if (line.empty())
+			continue;
+
+		std::string fields[6];
+		size_t start = 0;
+		for (int i = 0; i < 5; i++) {
+			size_t end = line.find('\t', start);
+			if (end == std::string::npos)
+				break;
+
+			fields[i] = line.substr(start, end - start);
+			start = end + 1;
+		}
+		fields[5] = line.substr(start);
+
+		if (fields[4].empty() || fields[5].empty())
+			continue;
+
+		ManifestEntry entry;
+		entry.contentHash = std::strtoull(fields[0].c_str(), nullptr, 16);
+		entry.size = std::strtoull(fields[1].c_str(), nullptr, 10);
+		entry.modifiedTime = std::strtoll(fields[2].c_str(), nullptr, 10);
+		entry.optionsFingerprint = std::strtoull(fields[3].c_str(), nullptr, 16);
+		entry.toolVersion = fields[4];
+		entries[fields[5]] = std::move(entry);
+	}
+
+	return true;
+}
+
+bool Manifest::Save(const std::string& fileName) const {
+	// Write to a temporary file first so that an interrupted save keeps the old manifest.
+	// Concurrent runs sharing the manifest each get their own, the last one to finish wins.
+	std::string tempFileName = PlatformUtil::GetTempFileName(fileName);
+
+	std::fstream file;
+	PlatformUtil::OpenFileStream(file, tempFileName, std::ios::out | std::ios::binary);
+	if (!file)
+		return false;
+
+	file << ManifestHeader << '\n';
+
+	for (auto& e : entries) {
+		const ManifestEntry& entry = e.second;
+		file << std::hex << entry.contentHash << '\t' << std::dec << entry.size << '\t' << entry.modifiedTime
+			 << '\t' << std::hex << entry.optionsFingerprint << std::dec << '\t' << entry.toolVersion << '\t'
+			 << e.first << '\n';
+	}
+
+	file.close();
+	if (!file.fail() && PlatformUtil::RenameFile(tempFileName, fileName))
+		return true;
+
+	std::error_code ec;
+	std::filesystem::remove(std::filesystem::u8path(tempFileName), ec);
+	return false;
+}
+
+bool Manifest::GetEntry(const std::string& file, ManifestEntry& outEntry) const {
+	auto it = entries.find(GetKey(file));
+	if (it == entries.end())
+		return false;
+
+	outEntry = it->second;
+	return true;
+}
+
+bool Manifest::IsUpToDate(const std::string& file,
+						  ManifestEntry& entry,
+						  uint64_t optionsFingerprint,
+						  bool& refreshed) {
+	refreshed = false;
+	if (entry.optionsFingerprint != optionsFingerprint || entry.toolVersion != ProgramVersionLabel)
+		return false;
+
+	uint64_t size = 0;
+	int64_t modifiedTime = 0;
+	if (!GetFileStatus(file, size, modifiedTime) || size != entry.size)
+		return false;
+
+	if (modifiedTime == entry.modifiedTime)
+		return true;
+
+	uint64_t contentHash = 0;
+	if (!HashFile(file, contentHash) || contentHash != entry.contentHash)
+		return false;
+
+	entry.modifiedTime = modifiedTime;
+	refreshed = true;
+	return true;
+}
+
+void Manifest::RefreshModifiedTime(const std::string& file, const ManifestEntry& entry) {
+	auto it = entries.find(GetKey(file));
+	if (it != entries.end() && it->second.contentHash == entry.contentHash && it->second.size == entry.size)
+		it->second.modifiedTime = entry.modifiedTime;
+}
+
+void Manifest::Record(const std::string& file, uint64_t contentHash, uint64_t optionsFingerprint) {
+	ManifestEntry entry;
+	if (!GetFileStatus(file, entry.size, entry.modifiedTime)) {
+		Remove(file);
+		return;
+	}
+
+	entry.contentHash = contentHash;
+	entry.optionsFingerprint = optionsFingerprint;
+	entry.toolVersion = ProgramVersionLabel;
+	entries[GetKey(file)] = std::move(entry);
+}
+
+void Manifest::Remove(const std::string& file) {
+	entries.erase(GetKey(file));
+}
+
+bool Manifest::GetFileStatus(const std::string& file, uint64_t& size, int64_t& modifiedTime) {
+	std::error_code ec;
+	std::filesystem::path path = std::filesystem::u8path(file);
+
+	size = std::filesystem::file_size(path, ec);
+	if (ec)
+		return false;
+
+	auto time = std::filesystem::last_write_time(path, ec);
+	if (ec)
+		return false;
+
+	modifiedTime = static_cast<int64_t>(time.time_since_epoch().count());
+	return true;
+}
+
+bool Manifest::HashFile(const std::string& file, uint64_t& contentHash) {
+	std::vector<char> data;
+	if (!PlatformUtil::ReadFile(file, data))
+		return false;
+
+	contentHash = HashBytes(data.data(), data.size());
+	return true;
+}
+
+std::string Manifest::GetKey(const std::string& file) {
+	std::error_code ec;
+	std::filesystem::path path = std::filesystem::absolute(std::filesystem::u8path(file), ec);
+	if (ec)
+		return file;
+
+	return path.lexically_normal().u8string();
+}
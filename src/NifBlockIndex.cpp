@@ -0,0 +1,157 @@
+/*
+SSE NIF Optimizer
+See the included LICENSE file
+*/
+
+#include "NifBlockIndex.hpp"
+
+#include <algorithm>
+
+using namespace nifly;
+
+namespace {
+template<typename T>
+T* FindFirst(const std::unordered_map<std::string, std::vector<T*>>& blocks, const std::string& name) {
+	auto it = blocks.find(name);
+	return it != blocks.end() && !it->second.empty() ? it->second.front() : nullptr;
+}
+
+template<typename T>
+void Remove(std::unordered_map<std::string, std::vector<T*>>& blocks, const std::string& name, T* block) {
+	auto it = blocks.find(name);
+	if (it == blocks.end())
+		return;
+
+	auto& list = it->second;
+	list.erase(std::remove(list.begin(), list.end(), block), list.end());
+	if (list.empty())
+		blocks.erase(it);
+}
+} // namespace
+
+NifBlockIndex::NifBlockIndex(NifFile* nif)
+	: nif(nif) {
+	auto& hdr = nif->GetHeader();
+	uint32_t blockCount = hdr.GetNumBlocks();
+
+	for (uint32_t id = 0; id < blockCount; id++) {
+		auto block = hdr.GetBlock<NiObjectNET>(id);
+		if (block)
+			AddName(block, block->name.get());
+
+		// NifFile::GetParentNode returns the first node that lists the block as a child
+		auto node = dynamic_cast<NiNode*>(block);
+		if (!node)
+			continue;
+
+		for (auto& child : node->childRefs) {
+			auto childBlock = hdr.GetBlock<NiObject>(child.index);
+			if (childBlock)
+				parents.emplace(childBlock, node);
+		}
+	}
+}
+
+NiNode* NifBlockIndex::FindNode(const std::string& name) const {
+	return FindFirst(nodes, name);
+}
+
+NiShape* NifBlockIndex::FindShape(const std::string& name) const {
+	return FindFirst(shapes, name);
+}
+
+NiNode* NifBlockIndex::GetParentNode(NiObject* block) const {
+	auto it = parents.find(block);
+	return it != parents.end() ? it->second : nullptr;
+}
+
+int NifBlockIndex::GetBlockID(NiObject* block) {
+	if (!blockIdsValid) {
+		auto& hdr = nif->GetHeader();
+		uint32_t blockCount = hdr.GetNumBlocks();
+
+		blockIds.clear();
+		blockIds.reserve(blockCount);
+		for (uint32_t id = 0; id < blockCount; id++)
+			blockIds.emplace(hdr.GetBlock<NiObject>(id), static_cast<int>(id));
+
+		blockIdsValid = true;
+	}
+
+	auto it = blockIds.find(block);
+	return it != blockIds.end() ? it->second : -1;
+}
+
+NiNode* NifBlockIndex::AddNode(const std::string& name, const MatTransform& xformToParent, NiNode* parent) {
+	NiNode* node = nif->AddNode(name, xformToParent, parent);
+	if (!node)
+		return nullptr;
+
+	// New blocks are added to the end
+	if (blockIdsValid)
+		blockIds[node] = static_cast<int>(nif->GetHeader().GetNumBlocks()) - 1;
+
+	AddName(node, name);
+	parents[node] = parent ? parent : nif->GetRootNode();
+	return node;
+}
+
+void NifBlockIndex::DeleteNode(const std::string& name) {
+	NiNode* node = FindNode(name);
+	if (!node)
+		return;
+
+	nif->DeleteNode(name);
+
+	// The references to the node are gone with it, its children are left without a parent
+	RemoveName(node, name);
+	parents.erase(node);
+	for (auto it = parents.begin(); it != parents.end();) {
+		if (it->second == node)
+			it = parents.erase(it);
+		else
+			++it;
+	}
+
+	blockIdsValid = false;
+}
+
+void NifBlockIndex::SetParentNode(NiObject* block, NiNode* parent) {
+	nif->SetParentNode(block, parent);
+	parents[block] = parent ? parent : nif->GetRootNode();
+}
+
+void NifBlockIndex::UpdateName(NiObjectNET* block, const std::string& oldName) {
+	RemoveName(block, oldName);
+
+	// Keeps the list of the new name in block order
+	auto insertOrdered = [&](auto& blocks, auto* typedBlock) {
+		auto& list = blocks[block->name.get()];
+		int id = GetBlockID(typedBlock);
+		auto pos = list.begin();
+		while (pos != list.end() && GetBlockID(*pos) < id)
+			++pos;
+
+		list.insert(pos, typedBlock);
+	};
+
+	if (auto node = dynamic_cast<NiNode*>(block))
+		insertOrdered(nodes, node);
+	else if (auto shape = dynamic_cast<NiShape*>(block))
+		insertOrdered(shapes, shape);
+}
+
+void NifBlockIndex::AddName(NiObjectNET* block, const std::string& name) {
+	// Blocks are only ever added to the end, so appending keeps the lists in block order
+	if (auto node = dynamic_cast<NiNode*>(block))
+		nodes[name].push_back(node);
+	else if (auto shape = dynamic_cast<NiShape*>(block))
+		shapes[name].push_back(shape);
+}
+
+void NifBlockIndex::RemoveName(NiObjectNET* block, const std::string& name) {
+	if (auto node = dynamic_cast<NiNode*>(block))
+		Remove(nodes, name, node);
+	else if (auto shape = dynamic_cast<NiShape*>(block))
+		Remove(shapes, name, shape);
+}
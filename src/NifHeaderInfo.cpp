@@ -0,0 +1,140 @@
+/*
+SSE NIF Optimizer
+See the included LICENSE file
+*/
+
+#include "NifHeaderInfo.hpp"
+
+#include <algorithm>
+
+namespace {
+constexpr uint32_t MaxHeaderString = 0x10000;
+
+template<typename T>
+bool ReadValue(std::istream& stream, T& value) {
+	stream.read(reinterpret_cast<char*>(&value), sizeof(T));
+	return !stream.fail();
+}
+
+// Export strings are prefixed with a byte length and include the null terminator
+bool ReadExportString(std::istream& stream, std::string& str) {
+	uint8_t length = 0;
+	if (!ReadValue(stream, length))
+		return false;
+
+	str.resize(length);
+	if (length > 0 && !stream.read(&str[0], length))
+		return false;
+
+	str.erase(std::find(str.begin(), str.end(), '\0'), str.end());
+	return true;
+}
+
+bool ReadSizedString(std::istream& stream, std::string& str) {
+	uint32_t length = 0;
+	if (!ReadValue(stream, length) || length > MaxHeaderString)
+		return false;
+
+	str.resize(length);
+	if (length > 0 && !stream.read(&str[0], length))
+		return false;
+
+	return true;
+}
+} // namespace
+
+bool NifHeaderInfo::Read(std::istream& stream) {
+	fileVersion = 0;
+	userVersion = 0;
+	streamVersion = 0;
+	numBlocks = 0;
+	exportInfo.clear();
+	blockTypes.clear();
+
+	// "Gamebryo File Format, Version 20.2.0.7\n"
+	char line[128]{};
+	stream.getline(line, sizeof(line), '\n');
+	if (stream.fail())
+		return false;
+
+	std::string headerString = line;
+	if (headerString.rfind("Gamebryo File Format", 0) != 0 && headerString.rfind("NetImmerse File Format", 0) != 0)
+		return false;
+
+	if (!ReadValue(stream, fileVersion))
+		return false;
+
+	// Only the header layout of Bethesda 20.x files is parsed here
+	if (fileVersion < 0x14000005)
+		return false;
+
+	uint8_t endian = 0;
+	if (!ReadValue(stream, endian) || endian != 1)
+		return false;
+
+	if (!ReadValue(stream, userVersion) || !ReadValue(stream, numBlocks))
+		return false;
+
+	if (userVersion >= 3) {
+		if (!ReadValue(stream, streamVersion))
+			return false;
+
+		std::string creator;
+		std::string exportInfo1;
+		std::string exportInfo2;
+		std::string maxFilepath;
+
+		if (!ReadExportString(stream, creator))
+			return false;
+
+		if (streamVersion > 130) {
+			uint32_t unknownInt = 0;
+			if (!ReadValue(stream, unknownInt))
+				return false;
+		}
+
+		if (streamVersion < 131 && !ReadExportString(stream, exportInfo1))
+			return false;
+
+		if (!ReadExportString(stream, exportInfo2))
+			return false;
+
+		if (streamVersion == 130 && !ReadExportString(stream, maxFilepath))
+			return false;
+
+		exportInfo = creator;
+		if (!exportInfo1.empty())
+			exportInfo += "\n" + exportInfo1;
+		if (!exportInfo2.empty())
+			exportInfo += "\n" + exportInfo2;
+	}
+
+	uint16_t numBlockTypes = 0;
+	if (!ReadValue(stream, numBlockTypes))
+		return false;
+
+	blockTypes.resize(numBlockTypes);
+	for (auto& blockType : blockTypes)
+		if (!ReadSizedString(stream, blockType))
+			return false;
+
+	// Validate the block type indices so that truncated headers are rejected
+	for (uint32_t i = 0; i < numBlocks; i++) {
+		uint16_t blockTypeIndex = 0;
+		if (!ReadValue(stream, blockTypeIndex))
+			return false;
+
+		if ((blockTypeIndex & 0x7FFF) >= numBlockTypes)
+			return false;
+	}
+
+	return true;
+}
+
+bool NifHeaderInfo::HasBlockType(const std::string& blockType) const {
+	return std::find(blockTypes.begin(), blockTypes.end(), blockType) != blockTypes.end();
+}
+
+bool NifHeaderInfo::IsVersion(uint32_t file, uint32_t user, uint32_t stream) const {
+	return fileVersion == file && userVersion == user && streamVersion == stream;
+}
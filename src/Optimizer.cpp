@@ -4,20 +4,23 @@ See the included LICENSE file
 */
 
 #include "Optimizer.hpp"
-#include "Anim.hpp"
 #include "DDS.h"
-#include "NifFile.hpp"
-#include "PlatformUtil.hpp"
+#include "DirectoryWalker.hpp"
+#include "FileView.hpp"
 
 using namespace nifly;
 
 wxIMPLEMENT_APP(OptimizerApp);
 wxDECLARE_APP(OptimizerApp);
 
+wxDEFINE_EVENT(EVT_WORKER_FINISHED, wxThreadEvent);
+
 bool OptimizerApp::OnInit() {
 	if (!wxApp::OnInit())
 		return false;
 
+	Bind(EVT_WORKER_FINISHED, &OptimizerApp::OnWorkerFinished, this);
+
 	frame = new Optimizer(nullptr);
 	frame->SetIcon(wxIcon("aaaaICON"));
 	frame->Show(true);
@@ -31,6 +34,7 @@ bool OptimizerApp::OnInit() {
 }
 
 int OptimizerApp::OnExit() {
+	StopWorker();
 	return 0;
 }
 
@@ -41,9 +45,18 @@ void OptimizerApp::OnInitCmdLine(wxCmdLineParser& parser) {
 bool OptimizerApp::OnCmdLineParsed(wxCmdLineParser& parser) {
 	parser.Found("opt", &cmdOptimize);
 	parser.Found("log", &cmdLogPath);
+	parser.Found("jsonlog", &cmdJsonLogPath);
+	parser.Found("trace", &cmdTracePath);
+	parser.Found("manifest", &cmdManifestPath);
 
 	cmdRecursive = parser.Found("recursive");
 	cmdHeadparts = parser.Found("headparts");
+	cmdPipeline = parser.Found("pipeline");
+	cmdForce = parser.Found("force");
+	cmdStats = parser.Found("stats");
+
+	cmdJobs = 0;
+	parser.Found("jobs", &cmdJobs);
 
 	cmdPaths.Clear();
 
@@ -59,7 +72,14 @@ void OptimizerApp::HandleCmdLine() {
 		options.recursive = cmdRecursive;
 		options.headParts = cmdHeadparts;
 		options.targetGame = cmdOptimize == "LE" ? TargetGame::LE : TargetGame::SSE;
-		options.logFilePath = cmdLogPath;
+		options.logFilePath = cmdLogPath.ToUTF8().data();
+		options.jsonLogFilePath = cmdJsonLogPath.ToUTF8().data();
+		options.traceFilePath = cmdTracePath.ToUTF8().data();
+		options.jobs = static_cast<int>(cmdJobs);
+		options.pipeline = cmdPipeline;
+		options.skipOptimized = !cmdForce;
+		options.reportStats = cmdStats;
+		options.manifestPath = cmdManifestPath.ToUTF8().data();
 
 		for (auto& path : cmdPaths) {
 			if (path.IsEmpty())
@@ -67,30 +87,22 @@ void OptimizerApp::HandleCmdLine() {
 
 			wxFileName fn(path);
 			if (fn.FileExists()) {
-				wxString ext = fn.GetExt().MakeLower();
-				if (ext != "nif" && ext != "btr" && ext != "bto")
+				std::string file = path.ToUTF8().data();
+				if (!OptimizerCore::IsOptimizableFile(file))
 					continue;
 
-				options.files.Add(path);
+				options.files.push_back(file);
 			}
 			else {
 				if (!wxDir::Exists(path))
 					continue;
 
-				int folderFlags = wxDIR_FILES | wxDIR_HIDDEN;
-				if (cmdRecursive)
-					folderFlags |= wxDIR_DIRS;
-
-				wxDir::GetAllFiles(path, &options.files, "*.nif", folderFlags);
-				wxDir::GetAllFiles(path, &options.files, "*.btr", folderFlags);
-				wxDir::GetAllFiles(path, &options.files, "*.bto", folderFlags);
+				options.folders.push_back(path.ToUTF8().data());
 			}
 		}
 
+		CloseWhenFinished();
 		Optimize(options);
-
-		if (frame)
-			frame->Close();
 	}
 }
 
@@ -98,202 +110,119 @@ void OptimizerApp::Optimize(const OptimizerOptions& options) {
 	if (frame)
 		frame->StartOptimize();
 
-	wxFile logFile;
-	if (!options.logFilePath.IsEmpty())
-		logFile.Open(options.logFilePath, wxFile::OpenMode::write);
-
-	Log(logFile, wxString::Format("==== %s by ousnius ====", ProgramVersionLabel));
-	Log(logFile, "----------------------------------------------------------------------");
-
-	Log(logFile, "[INFO] Options:");
-	if (!options.folder.IsEmpty())
-		Log(logFile, wxString::Format("- Folder: '%s'", options.folder));
-	Log(logFile, wxString::Format("- Sub Directories: %s", options.recursive ? "Yes" : "No"));
-	Log(logFile, wxString::Format("- Head Parts Only: %s", options.headParts ? "Yes" : "No"));
-	Log(logFile, wxString::Format("- Clean Skinning: %s", options.cleanSkinning ? "Yes" : "No"));
-	Log(logFile, wxString::Format("- Calculate Bounds: %s", options.calculateBounds ? "Yes" : "No"));
-	Log(logFile, wxString::Format("- Remove Parallax: %s", options.removeParallax ? "Yes" : "No"));
-	Log(logFile, wxString::Format("- Fix BSX Flags: %s", options.fixBSXFlags ? "Yes" : "No"));
-	Log(logFile, wxString::Format("- Fix Shader Flags: %s", options.fixShaderFlags ? "Yes" : "No"));
-	Log(logFile, wxString::Format("- Smooth Normals: %s", options.smoothNormals ? "Yes" : "No"));
-	if (options.smoothNormals) {
-		Log(logFile, wxString::Format("- Smooth Angle: %d", options.smoothAngle));
-		Log(logFile, wxString::Format("- Smooth Seam Normals: %s", options.smoothSeamNormals ? "Yes" : "No"));
-	}
-	Log(logFile);
-
-	size_t fileCount = options.files.GetCount();
-	Log(logFile, wxString::Format("[INFO] %zu file(s) were found.", fileCount));
-	Log(logFile, "----------------------------------------------------------------------");
-
-	float prog = 0.0f;
-	float step = 100.0f;
-
-	if (fileCount > 0)
-		step /= fileCount;
-
-	for (auto& file : options.files) {
-		wxFileName fileName(file);
-		wxString fileExt = fileName.GetExt().MakeLower();
-
-		if (frame)
-			frame->UpdateProgress(prog += step, wxString::Format("'%s'...", fileName.GetFullName()));
-
-		Log(logFile, wxString::Format("Loading '%s'...", file));
-
-		std::fstream fsOpen;
-		PlatformUtil::OpenFileStream(fsOpen, file.ToUTF8().data(), std::ios::in | std::ios::binary);
-
-		NifLoadOptions loadOptions;
-		loadOptions.isTerrain = (fileExt == "btr" || fileExt == "bto");
-
-		NifFile nif;
-		if (nif.Load(fsOpen, loadOptions) == 0) {
-			OptOptions optOptions;
-			optOptions.headParts = options.headParts;
-			optOptions.calcBounds = options.calculateBounds;
-			optOptions.removeParallax = options.removeParallax;
-			optOptions.fixBSXFlags = options.fixBSXFlags;
-			optOptions.fixShaderFlags = options.fixShaderFlags;
-
-			NiVersion version;
-			if (options.targetGame == TargetGame::SSE) {
-				version.SetFile(NiFileVersion::V20_2_0_7);
-				version.SetUser(12);
-				version.SetStream(100);
-			}
-			else {
-				version.SetFile(NiFileVersion::V20_2_0_7);
-				version.SetUser(12);
-				version.SetStream(83);
-			}
-			optOptions.targetVersion = version;
-
-			OptResult result = nif.OptimizeFor(optOptions);
-			if (result.versionMismatch) {
-				Log(logFile,
-					"[INFO] NIF version can't be saved with the target version (or already was). Skipping "
-					"conversion.");
-			}
-
-			if (result.dupesRenamed) {
-				Log(logFile, "[INFO] Renamed at least one shape with duplicate names.\r\n");
-			}
-
-			if (!result.shapesVColorsRemoved.empty()) {
-				wxString shapeList = "[INFO] Removed vertex colors from shapes:\r\n";
-				for (auto& s : result.shapesVColorsRemoved)
-					shapeList.Append(wxString::Format("- %s\r\n", s));
-
-				Log(logFile, shapeList);
+	RunWorker(
+		[this, options]() {
+			OptimizerCore core;
+
+			if (frame) {
+				core.progressCallback =
+					[this](const RunProgress& progress, const std::string& file, const FileResult&) {
+						wxString fileName = wxFileName(wxString::FromUTF8(file)).GetFullName();
+						wxString status = wxString::FromUTF8(progress.GetStatusText());
+						frame->PostProgress(progress.GetPercent(),
+											wxString::Format("'%s'... (%s)", fileName, status));
+					};
 			}
 
-			if (!result.shapesNormalsRemoved.empty()) {
-				wxString shapeList = "[INFO] Removed unnecessary normals and tangents from shapes:\r\n";
-				for (auto& s : result.shapesNormalsRemoved)
-					shapeList.Append(wxString::Format("- %s\r\n", s));
-
-				Log(logFile, shapeList);
-			}
-
-			if (!result.shapesPartTriangulated.empty()) {
-				wxString shapeList = "[INFO] Triangulated skin partitions of shapes:\r\n";
-				for (auto& s : result.shapesPartTriangulated)
-					shapeList.Append(wxString::Format("- %s\r\n", s));
-
-				Log(logFile, shapeList);
-			}
-
-			if (!result.shapesTangentsAdded.empty()) {
-				wxString shapeList = "[INFO] Added tangents to shapes:\r\n";
-				for (auto& s : result.shapesTangentsAdded)
-					shapeList.Append(wxString::Format("- %s\r\n", s));
+			core.idleCallback = [this]() { return !cancelRequested; };
+			core.Optimize(options);
+		},
+		[this]() {
+			if (frame)
+				frame->EndOptimize();
+		});
+}
 
-				Log(logFile, shapeList);
-			}
+void OptimizerApp::ScanTextures(const ScanOptions& options) {
+	if (frame)
+		frame->StartScanTextures();
 
-			if (!result.shapesParallaxRemoved.empty()) {
-				wxString shapeList = "[INFO] Removed parallax from shapes:\r\n";
-				for (auto& s : result.shapesParallaxRemoved)
-					shapeList.Append(wxString::Format("- %s\r\n", s));
+	auto logResult = std::make_shared<wxArrayString>();
 
-				Log(logFile, shapeList);
-			}
+	auto showResult = [this, logResult]() {
+		if (!frame)
+			return;
 
-			if (options.cleanSkinning) {
-				AnimSkeleton::getInstance().Clear();
-				AnimSkeleton::getInstance().DisableCustomTransforms();
+		frame->EndScanTextures();
 
-				AnimInfo anim;
-				anim.LoadFromNif(&nif);
+		if (!logResult->IsEmpty()) {
+			wxSingleChoiceDialog resultDialog(frame,
+											  "",
+											  "Texture Scan Result",
+											  *logResult,
+											  nullptr,
+											  wxDEFAULT_DIALOG_STYLE | wxOK | wxCENTRE | wxRESIZE_BORDER);
+			resultDialog.ShowModal();
+		}
+		else {
+			wxMessageBox("No errors were detected in the texture scan.", "Texture Scan");
+		}
+	};
 
-				if (!anim.shapeBones.empty()) {
-					Log(logFile, "[INFO] Skinned mesh: Cleaning up skin data and calculating bounds.");
-				}
+	RunWorker([this, options, logResult]() { ScanTextureFiles(options, *logResult); }, showResult);
+}
 
-				anim.WriteToNif(&nif);
-			}
+void OptimizerApp::StopWorker() {
+	if (!worker.joinable())
+		return;
 
-			if (options.smoothNormals) {
-				for (auto& s : nif.GetShapes()) {
-					nif.CalcNormalsForShape(s, options.smoothSeamNormals, options.smoothAngle);
-					nif.CalcTangentsForShape(s);
-				}
-			}
+	cancelRequested = true;
+	worker.join();
+	workerFinished = nullptr;
+}
 
-			std::string exportInfo = std::string("Optimized with ") + ProgramVersionLabel + ".";
-			nif.GetHeader().SetExportInfo(exportInfo);
-			nif.FinalizeData();
+void OptimizerApp::RunWorker(std::function<void()> task, std::function<void()> finished) {
+	StopWorker();
 
-			NifSaveOptions saveOptions;
-			saveOptions.optimize = false;
-			saveOptions.sortBlocks = false;
+	cancelRequested = false;
+	workerFinished = std::move(finished);
 
-			std::fstream fsSave;
-			PlatformUtil::OpenFileStream(fsSave, file.ToUTF8().data(), std::ios::out | std::ios::binary);
+	int workerId = ++lastWorkerId;
+	worker = std::thread([this, workerId, task = std::move(task)]() {
+		task();
 
-			if (nif.Save(fsSave, saveOptions) == 0) {
-				Log(logFile, "[SUCCESS] Saved file.");
-			}
-			else {
-				Log(logFile, "[ERROR] Failed to save file.");
-			}
-		}
-		else {
-			Log(logFile, wxString::Format("[ERROR] Failed to load '%s'.", file));
-		}
+		auto event = new wxThreadEvent(EVT_WORKER_FINISHED);
+		event->SetInt(workerId);
+		wxQueueEvent(this, event);
+	});
+}
 
-		Log(logFile, "----------------------------------------------------------------------");
+void OptimizerApp::OnWorkerFinished(wxThreadEvent& event) {
+	// Left over from a worker that was stopped
+	if (event.GetInt() != lastWorkerId || !worker.joinable())
+		return;
 
-		if (frame) {
-			wxSafeYield(frame);
+	worker.join();
 
-			if (!frame->isProcessing)
-				break;
-		}
-	}
+	auto finished = std::move(workerFinished);
+	workerFinished = nullptr;
+	if (finished)
+		finished();
 
-	Log(logFile, "Program finished.");
-
-	if (frame)
-		frame->EndOptimize();
+	if (closeWhenFinished && frame)
+		frame->Close();
 }
 
-void OptimizerApp::ScanTextures(const ScanOptions& options) {
-	if (frame)
-		frame->StartProgress();
-
-	int folderFlags = wxDIR_FILES | wxDIR_HIDDEN;
-	if (options.recursive)
-		folderFlags |= wxDIR_DIRS;
-
+void OptimizerApp::ScanTextureFiles(const ScanOptions& options, wxArrayString& logResult) {
+	// One pass over the folder for both extensions
 	wxArrayString files;
-	wxDir::GetAllFiles(options.folder, &files, "*.dds", folderFlags);
-	wxDir::GetAllFiles(options.folder, &files, "*.tga", folderFlags);
+	auto addTexture = [&files](const std::string& path, uint64_t) {
+		wxString file = wxString::FromUTF8(path);
+		wxString fileExt = wxFileName(file).GetExt().MakeLower();
+		if (fileExt == "dds" || fileExt == "tga")
+			files.Add(file);
+	};
+
+	DirectoryWalker::Walk({options.folder.ToUTF8().data()}, options.recursive, addTexture);
+
+	if (!cmdTracePath.IsEmpty()) {
+		Trace::Start();
+		Trace::SetThreadName("Main");
+	}
 
-	wxFile logFile;
+	AsyncLog logFile;
 	if (options.writeLog)
-		logFile.Open("SSE NIF Optimizer (Texture Scan).txt", wxFile::OpenMode::write);
+		logFile.Open("SSE NIF Optimizer (Texture Scan).txt");
 
 	Log(logFile, wxString::Format("==== %s (Texture Scan) by ousnius ====", ProgramVersionLabel));
 	Log(logFile, "----------------------------------------------------------------------");
@@ -313,14 +242,14 @@ void OptimizerApp::ScanTextures(const ScanOptions& options) {
 	if (fileCount > 0)
 		step /= fileCount;
 
-	wxArrayString logResult;
-
 	for (auto& file : files) {
+		TraceSpan fileSpan(file.ToUTF8().data());
+
 		wxFileName fileName(file);
 		wxString fileExt = fileName.GetExt().MakeLower();
 
 		if (frame)
-			frame->UpdateProgress(prog += step, wxString::Format("'%s'...", fileName.GetFullName()));
+			frame->PostProgress(prog += step, wxString::Format("'%s'...", fileName.GetFullName()));
 
 		wxArrayString fileLog;
 		if (fileExt == "tga") {
@@ -329,19 +258,29 @@ void OptimizerApp::ScanTextures(const ScanOptions& options) {
 			}
 		}
 		else {
-			std::fstream fsOpen;
-			PlatformUtil::OpenFileStream(fsOpen, file.ToUTF8().data(), std::ios::in | std::ios::binary);
+			// Only the headers are looked at, so only they are paged in or read
+			constexpr size_t headersSize = 4 + sizeof(DDS_HEADER) + sizeof(DDS_HEADER_DXT10);
 
-			if (fsOpen) {
+			FileView input;
+			if (input.Open(file.ToUTF8().data(), true, headersSize)) {
 				char ddsMagic[4];
 				DDS_HEADER dds;
 				DDS_HEADER_DXT10 dds10;
 
-				fsOpen.read(ddsMagic, sizeof(ddsMagic));
-				if (std::strncmp(ddsMagic, "DDS ", sizeof(ddsMagic)) == 0) {
-					fsOpen.read((char*) &dds, sizeof(DDS_HEADER));
+				// Copies the next bytes of the file, fails at its end
+				size_t offset = 0;
+				auto read = [&input, &offset](void* dest, size_t count) {
+					if (input.GetSize() - offset < count)
+						return false;
 
-					if (fsOpen) {
+					std::memcpy(dest, input.GetData() + offset, count);
+					offset += count;
+					return true;
+				};
+
+				bool hasMagic = read(ddsMagic, sizeof(ddsMagic));
+				if (hasMagic && std::strncmp(ddsMagic, "DDS ", sizeof(ddsMagic)) == 0) {
+					if (read(&dds, sizeof(DDS_HEADER))) {
 						if (dds.dwWidth % 4 != 0 || dds.dwHeight % 4 != 0) {
 							fileLog.Add(
 								wxString::Format("Dimensions must be divisible by 4 (currently %dx%d).",
@@ -375,9 +314,7 @@ void OptimizerApp::ScanTextures(const ScanOptions& options) {
 								fileLog.Add("DX10+ DDS formats are not supported.");
 							}
 
-							fsOpen.read((char*) &dds10, sizeof(DDS_HEADER_DXT10));
-
-							if (fsOpen) {
+							if (read(&dds10, sizeof(DDS_HEADER_DXT10))) {
 								if (dds10.dxgiFormat == DXGI_FORMAT_BC1_UNORM_SRGB
 									|| dds10.dxgiFormat == DXGI_FORMAT_BC2_UNORM_SRGB
 									|| dds10.dxgiFormat == DXGI_FORMAT_BC3_UNORM_SRGB
@@ -438,32 +375,15 @@ void OptimizerApp::ScanTextures(const ScanOptions& options) {
 			}
 		}
 
-		if (frame) {
-			wxSafeYield(frame);
-
-			if (!frame->isProcessing)
-				break;
-		}
+		if (cancelRequested)
+			break;
 	}
 
 	Log(logFile, "Program finished.");
+	logFile.Close();
 
-	if (frame) {
-		frame->EndProgress();
-
-		if (!logResult.IsEmpty()) {
-			wxSingleChoiceDialog resultDialog(frame,
-											  "",
-											  "Texture Scan Result",
-											  logResult,
-											  nullptr,
-											  wxDEFAULT_DIALOG_STYLE | wxOK | wxCENTRE | wxRESIZE_BORDER);
-			resultDialog.ShowModal();
-		}
-		else {
-			wxMessageBox("No errors were detected in the texture scan.", "Texture Scan");
-		}
-	}
+	if (!cmdTracePath.IsEmpty())
+		Trace::Stop(cmdTracePath.ToUTF8().data());
 }
 
 
@@ -591,6 +511,15 @@ Optimizer::Optimizer(
 	cbWriteLog->SetToolTip("Toggles writing of a log file with information about the optimization process.");
 	sizerBottom->Add(cbWriteLog, 0, wxALL, 5);
 
+	cbIncremental = new wxCheckBox(this, wxID_ANY, "Incremental");
+	cbIncremental->SetToolTip(
+		"Skips files that haven't changed since they were last optimized with the same options.");
+	sizerBottom->Add(cbIncremental, 0, wxALL, 5);
+
+	cbForce = new wxCheckBox(this, wxID_ANY, "Force");
+	cbForce->SetToolTip("Also processes files that this version already optimized with the same options.");
+	sizerBottom->Add(cbForce, 0, wxALL, 5);
+
 	rbSSE = new wxRadioButton(this, wxID_ANY, "SSE");
 	rbSSE->SetValue(true);
 	rbSSE->SetToolTip("Choose SSE as the target version.");
@@ -625,6 +554,9 @@ Optimizer::Optimizer(
 	cbSmoothNormals->Bind(wxEVT_CHECKBOX, &Optimizer::cbSmoothNormalsChecked, this);
 	btOptimize->Bind(wxEVT_BUTTON, &Optimizer::btOptimizeClicked, this);
 	btScanTextures->Bind(wxEVT_BUTTON, &Optimizer::btScanTexturesClicked, this);
+
+	progressTimer.SetOwner(this);
+	Bind(wxEVT_TIMER, &Optimizer::progressTimerTick, this, progressTimer.GetId());
 }
 
 Optimizer::~Optimizer() {
@@ -634,16 +566,24 @@ Optimizer::~Optimizer() {
 	cbSmoothNormals->Unbind(wxEVT_CHECKBOX, &Optimizer::cbSmoothNormalsChecked, this);
 	btOptimize->Unbind(wxEVT_BUTTON, &Optimizer::btOptimizeClicked, this);
 	btScanTextures->Unbind(wxEVT_BUTTON, &Optimizer::btScanTexturesClicked, this);
+	Unbind(wxEVT_TIMER, &Optimizer::progressTimerTick, this, progressTimer.GetId());
 }
 
 void Optimizer::onClose(wxCloseEvent& event) {
 	if (isProcessing) {
-		isProcessing = false;
-		event.Veto();
-	}
-	else {
-		Destroy();
+		if (event.CanVeto()) {
+			// The window closes once the worker is done with the files it already started
+			wxGetApp().CloseWhenFinished();
+			wxGetApp().CancelWorker();
+			event.Veto();
+			return;
+		}
+
+		wxGetApp().StopWorker();
 	}
+
+	progressTimer.Stop();
+	Destroy();
 }
 
 void Optimizer::dirCtrlChanged(wxFileDirPickerEvent& event) {
@@ -657,12 +597,12 @@ void Optimizer::cbSmoothNormalsChecked(wxCommandEvent& event) {
 
 void Optimizer::btOptimizeClicked(wxCommandEvent& event) {
 	if (isProcessing) {
-		isProcessing = false;
+		wxGetApp().CancelWorker();
 		return;
 	}
 
 	OptimizerOptions options;
-	options.folder = dirCtrl->GetPath();
+	options.folders.push_back(dirCtrl->GetPath().ToUTF8().data());
 	options.recursive = cbRecursive->GetValue();
 	options.smoothNormals = cbSmoothNormals->GetValue();
 	options.smoothAngle = numSmoothAngle->GetValue();
@@ -674,31 +614,25 @@ void Optimizer::btOptimizeClicked(wxCommandEvent& event) {
 	options.fixBSXFlags = cbFixBSXFlags->GetValue();
 	options.fixShaderFlags = cbFixShaderFlags->GetValue();
 	options.targetGame = rbSSE->GetValue() ? TargetGame::SSE : TargetGame::LE;
+	options.skipOptimized = !cbForce->GetValue();
 
 	if (cbWriteLog->IsChecked())
 		options.logFilePath = "SSE NIF Optimizer.txt";
-	
-	int folderFlags = wxDIR_FILES | wxDIR_HIDDEN;
-	if (options.recursive)
-		folderFlags |= wxDIR_DIRS;
 
-	wxDir::GetAllFiles(options.folder, &options.files, "*.nif", folderFlags);
-	wxDir::GetAllFiles(options.folder, &options.files, "*.btr", folderFlags);
-	wxDir::GetAllFiles(options.folder, &options.files, "*.bto", folderFlags);
+	if (cbIncremental->IsChecked())
+		options.manifestPath = "SSE NIF Optimizer.manifest";
+
+	options.traceFilePath = wxGetApp().GetTracePath().ToUTF8().data();
 
 	wxGetApp().Optimize(options);
 }
 
 void Optimizer::btScanTexturesClicked(wxCommandEvent& event) {
 	if (isProcessing) {
-		isProcessing = false;
+		wxGetApp().CancelWorker();
 		return;
 	}
 
-	btScanTextures->SetLabel("Cancel");
-	btOptimize->Disable();
-	isProcessing = true;
-
 	ScanOptions options;
 	options.folder = dirCtrl->GetPath();
 	options.recursive = cbRecursive->GetValue();
@@ -707,10 +641,22 @@ void Optimizer::btScanTexturesClicked(wxCommandEvent& event) {
 	options.writeLog = cbWriteLog->GetValue();
 
 	wxGetApp().ScanTextures(options);
+}
 
-	btScanTextures->SetLabel("Scan Textures");
-	btOptimize->Enable();
-	isProcessing = false;
+void Optimizer::progressTimerTick(wxTimerEvent& event) {
+	int val = 0;
+	wxString msg;
+	{
+		std::lock_guard<std::mutex> lock(postedMutex);
+		if (!progressPosted)
+			return;
+
+		val = postedProgress;
+		msg = postedMessage;
+		progressPosted = false;
+	}
+
+	UpdateProgress(val, msg);
 }
 
 void Optimizer::StartOptimize() {
@@ -729,6 +675,22 @@ void Optimizer::EndOptimize() {
 	isProcessing = false;
 }
 
+void Optimizer::StartScanTextures() {
+	btScanTextures->SetLabel("Cancel");
+	btOptimize->Disable();
+	isProcessing = true;
+
+	StartProgress();
+}
+
+void Optimizer::EndScanTextures() {
+	EndProgress();
+
+	btScanTextures->SetLabel("Scan Textures");
+	btOptimize->Enable();
+	isProcessing = false;
+}
+
 void Optimizer::StartProgress(const wxString& msg) {
 	if (progressStack.empty()) {
 		progressVal = 0;
@@ -742,6 +704,13 @@ void Optimizer::StartProgress(const wxString& msg) {
 			statusBar->SetStatusText("Processing...");
 		else
 			statusBar->SetStatusText(msg);
+
+		{
+			std::lock_guard<std::mutex> lock(postedMutex);
+			progressPosted = false;
+		}
+
+		progressTimer.Start(ProgressRefreshMs);
 	}
 }
 
@@ -778,6 +747,8 @@ void Optimizer::EndProgress(const wxString& msg) {
 	progressStack.pop_back();
 
 	if (progressStack.empty()) {
+		progressTimer.Stop();
+
 		if (msg.IsEmpty())
 			statusBar->SetStatusText("Ready!");
 		else
@@ -787,3 +758,10 @@ void Optimizer::EndProgress(const wxString& msg) {
 		progressBar = nullptr;
 	}
 }
+
+void Optimizer::PostProgress(int val, const wxString& msg) {
+	std::lock_guard<std::mutex> lock(postedMutex);
+	postedProgress = val;
+	postedMessage = msg;
+	progressPosted = true;
+}
@@ -0,0 +1,875 @@
+/*
+SSE NIF Optimizer
+See the included LICENSE file
+*/
+
+#include "OptimizerCore.hpp"
+#include "Anim.hpp"
+#include "Arena.hpp"
+#include "DirectoryWalker.hpp"
+#include "FileCommitter.hpp"
+#include "FileScheduler.hpp"
+#include "FileView.hpp"
+#include "Hash.hpp"
+#include "Json.hpp"
+#include "Manifest.hpp"
+#include "MemoryStream.hpp"
+#include "Pipeline.hpp"
+#include "RefSkeleton.hpp"
+#include "ThreadPool.hpp"
+#include "Trace.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+
+using namespace nifly;
+
+namespace {
+// Written to the header of every optimized file. Short enough for the first export string, which takes
+// up to 256 characters.
+std::string GetOptimizedExportInfo(const OptimizerOptions& options) {
+	char fingerprint[17];
+	unsigned long long hash = OptimizerCore::GetOptionsFingerprint(options);
+	std::snprintf(fingerprint, sizeof(fingerprint), "%016llx", hash);
+	return std::string("Optimized with ") + ProgramVersionLabel + " (options " + fingerprint + ").";
+}
+
+std::string GetLowerExtension(const std::string& file) {
+	std::string ext = std::filesystem::u8path(file).extension().u8string();
+	if (!ext.empty() && ext[0] == '.')
+		ext.erase(0, 1);
+
+	std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
+	return ext;
+}
+
+// Cached beside the manifest in incremental mode only
+std::shared_ptr<const RefSkeleton> GetReferenceSkeleton(const OptimizerOptions& options) {
+	if (!options.cleanSkinning || options.skeletonPath.empty())
+		return nullptr;
+
+	std::string cacheFileName;
+	if (!options.manifestPath.empty())
+		cacheFileName = RefSkeleton::GetCacheFileName(options.skeletonPath, options.manifestPath);
+	return RefSkeleton::Get(options.skeletonPath, cacheFileName);
+}
+
+const char* YesNo(bool value) {
+	return value ? "Yes" : "No";
+}
+} // namespace
+
+void OptimizerCore::Optimize(const OptimizerOptions& options) {
+	logFile.Close();
+	jsonLog.Close();
+
+	if (!options.logFilePath.empty())
+		logFile.Open(options.logFilePath);
+
+	if (!options.jsonLogFilePath.empty())
+		jsonLog.Open(options.jsonLogFilePath);
+
+	if (!options.traceFilePath.empty()) {
+		Trace::Start();
+		Trace::SetThreadName("Main");
+	}
+
+	Log(std::string("==== ") + ProgramVersionLabel + " by ousnius ====");
+	Log("----------------------------------------------------------------------");
+
+	ThreadPool pool(options.jobs > 0 ? options.jobs : 0);
+
+	Log("[INFO] Options:");
+	for (auto& folder : options.folders)
+		Log("- Folder: '" + folder + "'");
+	Log(std::string("- Sub Directories: ") + YesNo(options.recursive));
+	Log(std::string("- Head Parts Only: ") + YesNo(options.headParts));
+	Log(std::string("- Clean Skinning: ") + YesNo(options.cleanSkinning));
+	if (options.cleanSkinning && !options.skeletonPath.empty())
+		Log("- Reference Skeleton: '" + options.skeletonPath + "'");
+	if (options.cleanSkinning)
+		Log(std::string("- Fast Skin Bounds: ") + YesNo(options.fastSkinBounds));
+	Log(std::string("- Calculate Bounds: ") + YesNo(options.calculateBounds));
+	Log(std::string("- Remove Parallax: ") + YesNo(options.removeParallax));
+	Log(std::string("- Fix BSX Flags: ") + YesNo(options.fixBSXFlags));
+	Log(std::string("- Fix Shader Flags: ") + YesNo(options.fixShaderFlags));
+	Log(std::string("- Smooth Normals: ") + YesNo(options.smoothNormals));
+	if (options.smoothNormals) {
+		Log("- Smooth Angle: " + std::to_string(options.smoothAngle));
+		Log(std::string("- Smooth Seam Normals: ") + YesNo(options.smoothSeamNormals));
+	}
+	Log("- Threads: " + std::to_string(pool.GetThreadCount()));
+	Log(std::string("- Pipelined I/O: ") + YesNo(options.pipeline));
+	Log(std::string("- Memory-Mapped Files: ") + YesNo(options.memoryMap));
+	Log(std::string("- Arena Allocation: ") + YesNo(options.arenaAlloc && IsCountingAllocatorLinked()));
+	if (options.syncPolicy == SyncPolicy::EachFile)
+		Log("- Sync To Disk: Each File");
+	else if (options.syncPolicy == SyncPolicy::Batched)
+		Log("- Sync To Disk: Every " + std::to_string(options.syncBatchSize) + " Files");
+	else
+		Log("- Sync To Disk: No");
+	Log(std::string("- Skip Optimized Files: ") + YesNo(options.skipOptimized));
+	Log(std::string("- Performance Report: ") + YesNo(options.reportStats));
+	if (!options.manifestPath.empty())
+		Log("- Manifest: '" + options.manifestPath + "'");
+	Log();
+
+	// Loaded once up front and shared by all workers
+	if (options.cleanSkinning && !options.skeletonPath.empty()) {
+		auto skeleton = GetReferenceSkeleton(options);
+		if (skeleton)
+			Log("[INFO] Reference skeleton has " + std::to_string(skeleton->GetBones().size()) + " bones"
+				+ (skeleton->IsFromCache() ? " (cached)." : "."));
+		else
+			Log("[ERROR] Failed to load reference skeleton, bones keep the transforms of each file.");
+		Log();
+	}
+
+	Log("----------------------------------------------------------------------");
+
+	// In incremental mode, files recorded as unchanged aren't processed
+	Manifest manifest;
+	uint64_t optionsFingerprint = GetOptionsFingerprint(options);
+	bool incremental = !options.manifestPath.empty();
+
+	if (incremental)
+		manifest.Load(options.manifestPath);
+
+	std::atomic<bool> cancelled = false;
+
+	// Files are processed as soon as they're found, the largest waiting file goes first.
+	// The mutex also guards the manifest.
+	struct FinishedFile {
+		FileScheduler::Entry entry;
+		FileResult result;
+	};
+
+	FileScheduler scheduler;
+	std::mutex filesMutex;
+	std::condition_variable filesCondition;
+	std::deque<FinishedFile> finished;
+	size_t fileCount = 0;
+	uint64_t totalBytes = 0;
+	bool searchFinished = false;
+
+	auto finish = [&](const FileScheduler::Entry& entry, FileResult result) {
+		// Notified under the lock, Optimize may return as soon as the last file is handed over
+		std::lock_guard<std::mutex> lock(filesMutex);
+		finished.push_back({entry, std::move(result)});
+		filesCondition.notify_one();
+	};
+
+	// Saved files replace the originals through temporary files
+	FileCommitter committer(options.syncPolicy, options.syncBatchSize);
+
+	std::unique_ptr<OptimizerPipeline> pipeline;
+	if (options.pipeline)
+		pipeline = std::make_unique<OptimizerPipeline>(options, pool, cancelled, committer, finish);
+
+	auto dispatch = [&](const std::string& file, uint64_t fileSize) {
+		ManifestEntry entry;
+		bool recorded = false;
+		{
+			std::lock_guard<std::mutex> lock(filesMutex);
+			fileCount++;
+			totalBytes += fileSize;
+			recorded = incremental && manifest.GetEntry(file, entry);
+		}
+
+		// Checked outside the lock, a changed modification time means hashing the whole file
+		bool refreshed = false;
+		bool upToDate = recorded && Manifest::IsUpToDate(file, entry, optionsFingerprint, refreshed);
+		if (refreshed) {
+			std::lock_guard<std::mutex> lock(filesMutex);
+			manifest.RefreshModifiedTime(file, entry);
+		}
+
+		if (upToDate) {
+			FileResult result;
+			result.status = FileStatus::Unchanged;
+			finish({file, fileSize}, std::move(result));
+		}
+		else if (pipeline) {
+			pipeline->Add(file, fileSize);
+		}
+		else {
+			// Every task runs whichever file is the largest one waiting when it starts
+			scheduler.Push(file, fileSize);
+			pool.Submit([&]() {
+				FileScheduler::Entry entry;
+				if (!scheduler.TryPop(entry))
+					return;
+
+				// The future is dropped, a throwing file has to be reported here or the run never finishes
+				FileResult result;
+				try {
+					if (!cancelled)
+						result = OptimizeFile(entry.file, options, &committer);
+				}
+				catch (...) {
+					result = FileResult();
+					result.status = FileStatus::LoadFailed;
+				}
+
+				finish(entry, std::move(result));
+			});
+		}
+	};
+
+	for (auto& file : options.files) {
+		std::error_code ec;
+		uint64_t fileSize = std::filesystem::file_size(std::filesystem::u8path(file), ec);
+		dispatch(file, ec ? 0 : fileSize);
+	}
+
+	DirectoryWalker walker;
+	if (!options.folders.empty()) {
+		walker.Start(
+			options.folders,
+			options.recursive,
+			[&](const std::string& file, uint64_t fileSize) {
+				if (!cancelled && IsOptimizableFile(file))
+					dispatch(file, fileSize);
+			},
+			[&]() {
+				std::lock_guard<std::mutex> lock(filesMutex);
+				searchFinished = true;
+				filesCondition.notify_one();
+			});
+	}
+	else {
+		searchFinished = true;
+	}
+
+	auto cancel = [&]() {
+		cancelled = true;
+		walker.Stop();
+	};
+
+	runStats.Clear();
+	uint64_t startPinnedBytes = Arena::GetPinnedBytes();
+
+	// Results are collected in the order the files finish for the progress, the log and the JSON Lines
+	// output are written sorted by path at the end, so that runs on the same files produce the same logs
+	size_t statusCounts[FileStatusCount]{};
+	std::vector<std::pair<std::string, FileResult>> fileResults;
+	RunProgress progress;
+	auto startTime = std::chrono::steady_clock::now();
+
+	// Saved files are recorded once they've been replaced, which can be delayed by batching
+	std::vector<std::pair<std::string, uint64_t>> savedFiles;
+
+	for (;;) {
+		FinishedFile done;
+		{
+			std::unique_lock<std::mutex> lock(filesMutex);
+			while (finished.empty() && !(searchFinished && progress.filesDone == fileCount)) {
+				filesCondition.wait_for(lock, std::chrono::milliseconds(10));
+
+				if (idleCallback) {
+					lock.unlock();
+					if (!idleCallback())
+						cancel();
+					lock.lock();
+				}
+			}
+
+			if (finished.empty())
+				break;
+
+			done = std::move(finished.front());
+			finished.pop_front();
+
+			progress.filesDone++;
+			progress.bytesDone += done.entry.size;
+			progress.fileCount = fileCount;
+			progress.totalBytes = totalBytes;
+			progress.searchFinished = searchFinished;
+
+			if (incremental) {
+				FileStatus status = done.result.status;
+				if (status == FileStatus::Saved)
+					savedFiles.emplace_back(done.entry.file, done.result.contentHash);
+				else if (status == FileStatus::Identical)
+					manifest.Record(done.entry.file, done.result.contentHash, optionsFingerprint);
+				else if (status == FileStatus::LoadFailed || status == FileStatus::SaveFailed)
+					manifest.Remove(done.entry.file);
+			}
+		}
+
+		// Also checked between files, the wait above may not happen at all while files finish quickly
+		if (idleCallback && !idleCallback())
+			cancel();
+
+		const std::string& file = done.entry.file;
+		const FileResult& result = done.result;
+		if (result.status == FileStatus::Cancelled)
+			continue;
+
+		statusCounts[static_cast<size_t>(result.status)]++;
+		runStats.Add(file, result.stats);
+
+		if (progressCallback) {
+			std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - startTime;
+			progress.elapsedSeconds = elapsed.count();
+			progressCallback(progress, file, result);
+		}
+
+		fileResults.emplace_back(file, std::move(done.result));
+	}
+
+	walker.Wait();
+	if (pipeline)
+		pipeline->Finish();
+
+	std::sort(fileResults.begin(), fileResults.end(), [](const auto& a, const auto& b) {
+		return a.first < b.first;
+	});
+
+	// Files of batches that couldn't be replaced were reported as saved already, the progress gets them once
+	// more and their log entries are replaced
+	std::vector<std::string> failedFiles = committer.Commit();
+	for (auto& file : failedFiles) {
+		statusCounts[static_cast<size_t>(FileStatus::Saved)]--;
+		statusCounts[static_cast<size_t>(FileStatus::SaveFailed)]++;
+
+		FileResult result;
+		result.status = FileStatus::SaveFailed;
+		result.replaceFailed = true;
+
+		if (progressCallback) {
+			std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - startTime;
+			progress.elapsedSeconds = elapsed.count();
+			progressCallback(progress, file, result);
+		}
+
+		auto logged = std::lower_bound(
+			fileResults.begin(), fileResults.end(), file, [](const auto& entry, const std::string& path) {
+				return entry.first < path;
+			});
+		if (logged != fileResults.end() && logged->first == file) {
+			result.stats = logged->second.stats;
+			logged->second = std::move(result);
+		}
+	}
+
+	for (auto& logged : fileResults) {
+		LogFileResult(logged.first, logged.second);
+
+		if (jsonLog.IsOpen())
+			jsonLog.WriteLine(GetJsonResult(logged.first, logged.second), "\n");
+	}
+
+	for (auto& saved : savedFiles) {
+		if (std::find(failedFiles.begin(), failedFiles.end(), saved.first) == failedFiles.end())
+			manifest.Record(saved.first, saved.second, optionsFingerprint);
+		else
+			manifest.Remove(saved.first);
+	}
+
+	Log("[INFO] " + std::to_string(fileCount) + " file(s) were found.");
+
+	auto statusCount = [&statusCounts](FileStatus status) {
+		return std::to_string(statusCounts[static_cast<size_t>(status)]);
+	};
+
+	Log("[INFO] Summary:");
+	Log("- Saved: " + statusCount(FileStatus::Saved));
+	Log("- Not rewritten (identical output): " + statusCount(FileStatus::Identical));
+	Log("- Skipped (already optimized): " + statusCount(FileStatus::AlreadyOptimized));
+	if (incremental)
+		Log("- Skipped (unchanged since the last run): " + statusCount(FileStatus::Unchanged));
+	Log("- Failed to load: " + statusCount(FileStatus::LoadFailed));
+	Log("- Failed to save: " + statusCount(FileStatus::SaveFailed));
+	Log("----------------------------------------------------------------------");
+
+	if (options.reportStats) {
+		runStats.SetArenaPinnedBytes(Arena::GetPinnedBytes() - startPinnedBytes);
+		logFile.Write(runStats.FormatReport(options.slowestFiles, "\r\n"));
+		Log("----------------------------------------------------------------------");
+	}
+
+	if (incremental && !manifest.Save(options.manifestPath))
+		Log("[ERROR] Failed to save manifest '" + options.manifestPath + "'.");
+
+	if (!options.traceFilePath.empty() && !Trace::Stop(options.traceFilePath))
+		Log("[ERROR] Failed to write trace '" + options.traceFilePath + "'.");
+
+	Log("Program finished.");
+	logFile.Close();
+	jsonLog.Close();
+}
+
+void OptimizerCore::FindFiles(const std::string& folder, bool recursive, std::vector<std::string>& files) {
+	DirectoryWalker::Walk({folder}, recursive, [&files](const std::string& file, uint64_t) {
+		if (IsOptimizableFile(file))
+			files.push_back(file);
+	});
+}
+
+bool OptimizerCore::IsOptimizableFile(const std::string& file) {
+	std::string ext = GetLowerExtension(file);
+	return ext == "nif" || ext == "btr" || ext == "bto";
+}
+
+NifLoadOptions OptimizerCore::GetLoadOptions(const std::string& file) {
+	std::string fileExt = GetLowerExtension(file);
+
+	NifLoadOptions loadOptions;
+	loadOptions.isTerrain = (fileExt == "btr" || fileExt == "bto");
+	return loadOptions;
+}
+
+FileResult OptimizerCore::OptimizeFile(const std::string& file,
+									   const OptimizerOptions& options,
+									   FileCommitter* committer) {
+	TraceSpan fileSpan(file);
+
+	FileResult result;
+	PhaseTimer readTimer(result.stats, Phase::Read);
+
+	// Mapped files are only paged in as far as they're parsed, which keeps the header check cheap
+	FileView input;
+	if (!input.Open(file, options.memoryMap)) {
+		result.status = FileStatus::LoadFailed;
+		return result;
+	}
+
+	readTimer.Stop();
+	PhaseStats readStats = result.stats[Phase::Read];
+
+	std::vector<char> outData;
+	result = OptimizeBuffer(input.GetData(), input.GetSize(), outData, GetLoadOptions(file), options);
+	result.stats[Phase::Read] = readStats;
+
+	// The mapping has to be gone before the file can be replaced
+	input.Close();
+
+	if (result.status == FileStatus::Saved) {
+		PhaseTimer writeTimer(result.stats, Phase::Write);
+
+		// Without a shared committer, the file is replaced right away
+		std::unique_ptr<FileCommitter> ownCommitter;
+		if (!committer) {
+			bool syncEach = options.syncPolicy != SyncPolicy::None;
+			ownCommitter = std::make_unique<FileCommitter>(syncEach ? SyncPolicy::EachFile : SyncPolicy::None);
+			committer = ownCommitter.get();
+		}
+
+		if (committer->Write(file, outData.data(), outData.size()))
+			result.stats.bytesWritten = outData.size();
+		else
+			result.status = FileStatus::SaveFailed;
+	}
+
+	return result;
+}
+
+FileResult OptimizerCore::OptimizeBuffer(const std::vector<char>& inData,
+										 std::vector<char>& outData,
+										 const NifLoadOptions& loadOptions,
+										 const OptimizerOptions& options) {
+	return OptimizeBuffer(inData.data(), inData.size(), outData, loadOptions, options);
+}
+
+FileResult OptimizerCore::OptimizeBuffer(const char* inData,
+										 size_t inSize,
+										 std::vector<char>& outData,
+										 const NifLoadOptions& loadOptions,
+										 const OptimizerOptions& options) {
+	if (options.skipOptimized) {
+		MemoryInputBuf inBuf(inData, inSize);
+		std::istream inStream(&inBuf);
+
+		NifHeaderInfo header;
+		if (header.Read(inStream) && !NeedsOptimization(header, options)) {
+			FileResult result;
+			result.status = FileStatus::AlreadyOptimized;
+			return result;
+		}
+	}
+
+	return ProcessBuffer(inData, inSize, outData, loadOptions, options);
+}
+
+FileResult OptimizerCore::ProcessBuffer(const char* inData,
+										size_t inSize,
+										std::vector<char>& outData,
+										const NifLoadOptions& loadOptions,
+										const OptimizerOptions& options) {
+	FileResult result;
+	result.stats.bytesRead = inSize;
+
+	// The skeleton lives on between files, so it can't be created in the arena
+	if (options.cleanSkinning) {
+		AnimSkeleton::getInstance().SetReference(GetReferenceSkeleton(options));
+	}
+
+	// Arenas are served by the counting allocator, programs without it use the default allocator throughout
+	bool arenaAlloc = options.arenaAlloc && IsCountingAllocatorLinked();
+	if (arenaAlloc) {
+		static std::once_flag primed;
+		std::call_once(primed, PrimeStatics, options);
+	}
+
+	ArenaScope arena(arenaAlloc);
+
+	PhaseTimer loadTimer(result.stats, Phase::Load);
+
+	MemoryInputBuf inBuf(inData, inSize);
+	std::istream inStream(&inBuf);
+
+	NifFile nif;
+	if (nif.Load(inStream, loadOptions) != 0) {
+		result.status = FileStatus::LoadFailed;
+		return result;
+	}
+
+	loadTimer.Stop();
+	result.stats.blockCount = nif.GetHeader().GetNumBlocks();
+
+	OptimizeNif(nif, options, result);
+
+	PhaseTimer saveTimer(result.stats, Phase::Save);
+
+	// The results and the output outlive the arena
+	ArenaPause pause;
+	if (arena.IsActive())
+		result.optResult = OptResult(result.optResult);
+
+	NifSaveOptions saveOptions;
+	saveOptions.optimize = false;
+	saveOptions.sortBlocks = false;
+
+	MemoryOutputBuf outBuf(outData, inSize);
+	std::ostream outStream(&outBuf);
+
+	bool saved = nif.Save(outStream, saveOptions) == 0 && outStream.good();
+	result.stats.arenaBytes = arena.GetUsedBytes();
+
+	if (!saved) {
+		outData.clear();
+		result.status = FileStatus::SaveFailed;
+		return result;
+	}
+
+	outBuf.Finish();
+	result.status = FileStatus::Saved;
+
+	// Files that come out byte for byte the same aren't written again
+	result.contentHash = HashBytes(outData.data(), outData.size());
+	if (outData.size() == inSize && HashBytes(inData, inSize) == result.contentHash
+		&& std::memcmp(outData.data(), inData, inSize) == 0)
+		result.status = FileStatus::Identical;
+
+	return result;
+}
+
+uint64_t OptimizerCore::GetOptionsFingerprint(const OptimizerOptions& options) {
+	std::string fingerprint;
+	fingerprint += options.targetGame == TargetGame::LE ? "LE" : "SSE";
+	fingerprint += options.headParts ? ";headParts" : "";
+	fingerprint += options.cleanSkinning ? ";cleanSkinning" : "";
+	if (options.cleanSkinning && !options.skeletonPath.empty()) {
+		// Editing the skeleton changes the output of every skinned file
+		auto skeleton = GetReferenceSkeleton(options);
+		fingerprint += ";skeleton=" + options.skeletonPath;
+		fingerprint += ";skeletonHash=" + std::to_string(skeleton ? skeleton->GetSourceHash() : 0);
+	}
+	if (options.cleanSkinning && options.fastSkinBounds)
+		fingerprint += ";fastSkinBounds";
+	fingerprint += options.calculateBounds ? ";calculateBounds" : "";
+	fingerprint += options.removeParallax ? ";removeParallax" : "";
+	fingerprint += options.fixBSXFlags ? ";fixBSXFlags" : "";
+	fingerprint += options.fixShaderFlags ? ";fixShaderFlags" : "";
+
+	if (options.smoothNormals) {
+		fingerprint += ";smoothNormals=" + std::to_string(options.smoothAngle);
+		fingerprint += options.smoothSeamNormals ? ";smoothSeamNormals" : "";
+	}
+
+	return HashString(fingerprint);
+}
+
+NiVersion OptimizerCore::GetTargetVersion(TargetGame targetGame) {
+	NiVersion version;
+	if (targetGame == TargetGame::SSE) {
+		version.SetFile(NiFileVersion::V20_2_0_7);
+		version.SetUser(12);
+		version.SetStream(100);
+	}
+	else {
+		version.SetFile(NiFileVersion::V20_2_0_7);
+		version.SetUser(12);
+		version.SetStream(83);
+	}
+	return version;
+}
+
+bool OptimizerCore::NeedsOptimization(const NifHeaderInfo& header, const OptimizerOptions& options) {
+	if (!options.skipOptimized || options.smoothNormals)
+		return true;
+
+	NiVersion target = GetTargetVersion(options.targetGame);
+	if (!header.IsVersion(target.File(), target.User(), target.Stream()))
+		return true;
+
+	// Files optimized by other versions may be missing fixes of this one, files optimized with other
+	// options may be missing some of these
+	return header.exportInfo != GetOptimizedExportInfo(options);
+}
+
+void OptimizerCore::OptimizeNif(NifFile& nif, const OptimizerOptions& options, FileResult& result) {
+	OptOptions optOptions;
+	optOptions.headParts = options.headParts;
+	optOptions.calcBounds = options.calculateBounds;
+	optOptions.removeParallax = options.removeParallax;
+	optOptions.fixBSXFlags = options.fixBSXFlags;
+	optOptions.fixShaderFlags = options.fixShaderFlags;
+
+	optOptions.targetVersion = GetTargetVersion(options.targetGame);
+
+	{
+		PhaseTimer timer(result.stats, Phase::OptimizeFor);
+		result.optResult = nif.OptimizeFor(optOptions);
+	}
+
+	if (options.cleanSkinning) {
+		PhaseTimer loadTimer(result.stats, Phase::SkinLoad);
+
+		AnimSkeleton::getInstance().Clear();
+		AnimSkeleton::getInstance().DisableCustomTransforms();
+
+		AnimInfo anim;
+		anim.boundsMode = options.fastSkinBounds ? SkinBoundsMode::Approximate : SkinBoundsMode::Exact;
+		anim.LoadFromNif(&nif);
+
+		result.skinned = !anim.shapeBones.empty();
+		loadTimer.Stop();
+
+		PhaseTimer writeTimer(result.stats, Phase::SkinWrite);
+		std::vector<std::string> cleanedShapes = anim.CleanupBones();
+		anim.WriteToNif(&nif);
+
+		// Bone indices of the shapes that lost bones have changed, so their partitions are rebuilt
+		for (auto& shapeName : cleanedShapes) {
+			if (auto shape = nif.FindBlockByName<NiShape>(shapeName))
+				nif.UpdateSkinPartitions(shape);
+		}
+
+		// Bones of this file aren't needed anymore, which also leaves nothing of it behind in an arena
+		AnimSkeleton::getInstance().Clear();
+	}
+
+	if (options.smoothNormals) {
+		PhaseTimer timer(result.stats, Phase::Normals);
+
+		for (auto& s : nif.GetShapes()) {
+			nif.CalcNormalsForShape(s, options.smoothSeamNormals, options.smoothAngle);
+			nif.CalcTangentsForShape(s);
+		}
+	}
+
+	nif.GetHeader().SetExportInfo(GetOptimizedExportInfo(options));
+	nif.FinalizeData();
+}
+
+void OptimizerCore::PrimeStatics(const OptimizerOptions& options) {
+	NifFile nif;
+	nif.Create(GetTargetVersion(options.targetGame));
+
+	std::vector<char> inData;
+	MemoryOutputBuf inBuf(inData, 0);
+	std::ostream inStream(&inBuf);
+	if (nif.Save(inStream) != 0 || !inStream.good())
+		return;
+	inBuf.Finish();
+
+	OptimizerOptions primeOptions = options;
+	primeOptions.arenaAlloc = false;
+	primeOptions.skipOptimized = false;
+
+	std::vector<char> outData;
+	ProcessBuffer(inData.data(), inData.size(), outData, NifLoadOptions(), primeOptions);
+}
+
+void OptimizerCore::Log(const std::string& msg) {
+	logFile.WriteLine(msg);
+}
+
+void OptimizerCore::LogFileResult(const std::string& file, const FileResult& result) {
+	if (!logFile.IsOpen())
+		return;
+
+	if (result.status == FileStatus::Unchanged) {
+		Log("[INFO] Skipped '" + file + "' (unchanged since the last run).");
+		return;
+	}
+
+	if (result.status == FileStatus::AlreadyOptimized) {
+		Log("[INFO] Skipped '" + file + "' (already optimized for the target version).");
+		return;
+	}
+
+	if (result.replaceFailed) {
+		Log("[ERROR] Failed to replace '" + file + "', the original file was kept.");
+		return;
+	}
+
+	// The whole block is handed to the log at once
+	std::string entry;
+	auto addLine = [&entry](const std::string& line) {
+		entry += line;
+		entry += "\r\n";
+	};
+
+	addLine("Loading '" + file + "'...");
+
+	if (result.status == FileStatus::LoadFailed) {
+		addLine("[ERROR] Failed to load '" + file + "'.");
+		addLine("----------------------------------------------------------------------");
+		logFile.Write(entry);
+		return;
+	}
+
+	const OptResult& optResult = result.optResult;
+	if (optResult.versionMismatch) {
+		addLine("[INFO] NIF version can't be saved with the target version (or already was). Skipping "
+				"conversion.");
+	}
+
+	if (optResult.dupesRenamed) {
+		addLine("[INFO] Renamed at least one shape with duplicate names.\r\n");
+	}
+
+	auto addShapeList = [&](const char* header, const std::vector<std::string>& shapes) {
+		if (shapes.empty())
+			return;
+
+		addLine(header);
+		for (auto& s : shapes)
+			addLine("- " + s);
+
+		addLine("");
+	};
+
+	addShapeList("[INFO] Removed vertex colors from shapes:", optResult.shapesVColorsRemoved);
+	addShapeList("[INFO] Removed unnecessary normals and tangents from shapes:", optResult.shapesNormalsRemoved);
+	addShapeList("[INFO] Triangulated skin partitions of shapes:", optResult.shapesPartTriangulated);
+	addShapeList("[INFO] Added tangents to shapes:", optResult.shapesTangentsAdded);
+	addShapeList("[INFO] Removed parallax from shapes:", optResult.shapesParallaxRemoved);
+
+	if (result.skinned) {
+		addLine("[INFO] Skinned mesh: Cleaning up skin data and calculating bounds.");
+	}
+
+	if (result.status == FileStatus::Saved) {
+		addLine("[SUCCESS] Saved file.");
+	}
+	else if (result.status == FileStatus::Identical) {
+		addLine("[SUCCESS] File is already optimized, output is identical. Not rewritten.");
+	}
+	else {
+		addLine("[ERROR] Failed to save file.");
+	}
+
+	addLine("----------------------------------------------------------------------");
+	logFile.Write(entry);
+}
+
+const char* OptimizerCore::GetStatusName(FileStatus status) {
+	switch (status) {
+		case FileStatus::Cancelled: return "cancelled";
+		case FileStatus::LoadFailed: return "loadFailed";
+		case FileStatus::SaveFailed: return "saveFailed";
+		case FileStatus::Saved: return "saved";
+		case FileStatus::Identical: return "identical";
+		case FileStatus::Unchanged: return "unchanged";
+		case FileStatus::AlreadyOptimized: return "alreadyOptimized";
+	}
+
+	return "unknown";
+}
+
+std::string OptimizerCore::GetJsonResult(const std::string& file, const FileResult& result) {
+	auto list = [](const std::vector<std::string>& shapes) {
+		std::string out = "[";
+		for (size_t i = 0; i < shapes.size(); i++) {
+			if (i > 0)
+				out += ',';
+			out += QuoteJson(shapes[i]);
+		}
+		out += ']';
+		return out;
+	};
+
+	auto boolean = [](bool value) { return value ? "true" : "false"; };
+
+	bool success = result.status != FileStatus::Cancelled && result.status != FileStatus::LoadFailed
+				   && result.status != FileStatus::SaveFailed;
+
+	const OptResult& optResult = result.optResult;
+
+	std::string json = "{\"file\":" + QuoteJson(file);
+	json += ",\"status\":\"" + std::string(GetStatusName(result.status)) + "\"";
+	json += ",\"success\":" + std::string(boolean(success));
+	json += ",\"replaceFailed\":" + std::string(boolean(result.replaceFailed));
+	json += ",\"skinned\":" + std::string(boolean(result.skinned));
+	json += ",\"versionMismatch\":" + std::string(boolean(optResult.versionMismatch));
+	json += ",\"dupesRenamed\":" + std::string(boolean(optResult.dupesRenamed));
+	json += ",\"shapesVColorsRemoved\":" + list(optResult.shapesVColorsRemoved);
+	json += ",\"shapesNormalsRemoved\":" + list(optResult.shapesNormalsRemoved);
+	json += ",\"shapesPartTriangulated\":" + list(optResult.shapesPartTriangulated);
+	json += ",\"shapesTangentsAdded\":" + list(optResult.shapesTangentsAdded);
+	json += ",\"shapesParallaxRemoved\":" + list(optResult.shapesParallaxRemoved);
+	json += '}';
+	return json;
+}
+
+double RunProgress::GetPercent() const {
+	double done = 0.0;
+	if (totalBytes > 0)
+		done = static_cast<double>(bytesDone) / totalBytes;
+	else if (fileCount > 0)
+		done = static_cast<double>(filesDone) / fileCount;
+
+	return std::min(done, 1.0) * 100.0;
+}
+
+double RunProgress::GetSecondsLeft() const {
+	// Files that are yet to be found would be missing from the estimate
+	if (!searchFinished || bytesDone == 0 || elapsedSeconds <= 0.0)
+		return -1.0;
+
+	double bytesPerSecond = bytesDone / elapsedSeconds;
+	return (totalBytes - bytesDone) / bytesPerSecond;
+}
+
+std::string RunProgress::GetStatusText() const {
+	constexpr double MB = 1024.0 * 1024.0;
+
+	char text[64];
+	std::snprintf(text, sizeof(text), "%.1f / %.1f MB", bytesDone / MB, totalBytes / MB);
+
+	double secondsLeft = GetSecondsLeft();
+	if (secondsLeft < 0.0)
+		return text;
+
+	auto seconds = static_cast<unsigned long long>(secondsLeft + 0.5);
+	unsigned long long hours = seconds / 3600;
+	unsigned long long minutes = seconds / 60 % 60;
+
+	char timeLeft[32];
+	if (hours > 0)
+		std::snprintf(timeLeft, sizeof(timeLeft), "%llu:%02llu:%02llu", hours, minutes, seconds % 60);
+	else
+		std::snprintf(timeLeft, sizeof(timeLeft), "%llu:%02llu", minutes, seconds % 60);
+
+	return std::string(text) + ", about " + timeLeft + " left";
+}
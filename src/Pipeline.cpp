@@ -0,0 +1,145 @@
+/*
+SSE NIF Optimizer
+See the included LICENSE file
+*/
+
+#include "Pipeline.hpp"
+#include "PlatformUtil.hpp"
+#include "Trace.hpp"
+
+OptimizerPipeline::OptimizerPipeline(const OptimizerOptions& options,
+									 ThreadPool& pool,
+									 std::atomic<bool>& cancelled,
+									 FileCommitter& committer,
+									 FinishedCallback onFinished)
+	: options(options)
+	, cancelled(cancelled)
+	, committer(committer)
+	, onFinished(std::move(onFinished))
+	, readQueue(pool.GetThreadCount() * 2, QueueBytes)
+	, writeQueue(pool.GetThreadCount() * 2, QueueBytes) {
+	workersRunning = pool.GetThreadCount();
+	for (size_t i = 0; i < pool.GetThreadCount(); i++)
+		workers.push_back(pool.Submit([this]() { OptimizeLoop(); }));
+
+	reader = std::thread(&OptimizerPipeline::ReadLoop, this);
+	writer = std::thread(&OptimizerPipeline::WriteLoop, this);
+}
+
+OptimizerPipeline::~OptimizerPipeline() {
+	Finish();
+
+	reader.join();
+
+	for (auto& worker : workers)
+		worker.wait();
+
+	writer.join();
+}
+
+void OptimizerPipeline::Add(const std::string& file, uint64_t fileSize) {
+	inputQueue.Push(file, fileSize);
+}
+
+void OptimizerPipeline::Finish() {
+	inputQueue.Close();
+}
+
+void OptimizerPipeline::ReadLoop() {
+	Trace::SetThreadName("Reader");
+
+	FileScheduler::Entry entry;
+	while (inputQueue.Pop(entry)) {
+		if (cancelled) {
+			onFinished(entry, FileResult());
+			continue;
+		}
+
+		ReadItem item;
+		item.entry = std::move(entry);
+
+		FileStats stats;
+		bool loaded = false;
+		{
+			TraceSpan fileSpan(item.entry.file);
+			PhaseTimer readTimer(stats, Phase::Read);
+			loaded = PlatformUtil::ReadFile(item.entry.file, item.data);
+		}
+
+		if (!loaded) {
+			FileResult result;
+			result.status = FileStatus::LoadFailed;
+			onFinished(item.entry, std::move(result));
+			continue;
+		}
+
+		item.readStats = stats[Phase::Read];
+
+		size_t bytes = item.data.size();
+		TraceSpan waitSpan("Queue Full", "wait");
+		readQueue.Push(std::move(item), bytes);
+	}
+
+	readQueue.Close();
+}
+
+void OptimizerPipeline::OptimizeLoop() {
+	ReadItem item;
+	while (readQueue.Pop(item)) {
+		if (cancelled) {
+			onFinished(item.entry, FileResult());
+			continue;
+		}
+
+		WriteItem out;
+		out.entry = std::move(item.entry);
+		try {
+			TraceSpan fileSpan(out.entry.file);
+			out.result = OptimizerCore::OptimizeBuffer(item.data,
+													   out.data,
+													   OptimizerCore::GetLoadOptions(out.entry.file),
+													   options);
+			out.result.stats[Phase::Read] = item.readStats;
+		}
+		catch (...) {
+			// A throwing file mustn't end the loop, the write stage only closes once every worker returned
+			out.data.clear();
+			out.result = FileResult();
+			out.result.status = FileStatus::LoadFailed;
+		}
+
+		// Release the input buffer before blocking on the write queue
+		item.data = std::vector<char>();
+
+		// Only changed files go through the write stage
+		if (out.result.status != FileStatus::Saved) {
+			onFinished(out.entry, std::move(out.result));
+			continue;
+		}
+
+		size_t bytes = out.data.size();
+		TraceSpan waitSpan("Queue Full", "wait");
+		writeQueue.Push(std::move(out), bytes);
+	}
+
+	// The last worker to finish ends the write stage
+	if (--workersRunning == 0)
+		writeQueue.Close();
+}
+
+void OptimizerPipeline::WriteLoop() {
+	Trace::SetThreadName("Writer");
+
+	WriteItem item;
+	while (writeQueue.Pop(item)) {
+		TraceSpan fileSpan(item.entry.file);
+		PhaseTimer writeTimer(item.result.stats, Phase::Write);
+		if (committer.Write(item.entry.file, item.data.data(), item.data.size()))
+			item.result.stats.bytesWritten = item.data.size();
+		else
+			item.result.status = FileStatus::SaveFailed;
+		writeTimer.Stop();
+
+		onFinished(item.entry, std::move(item.result));
+	}
+}
@@ -5,6 +5,17 @@ See the included LICENSE file
 
 #include "PlatformUtil.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <filesystem>
+
+#ifndef _WINDOWS
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 namespace PlatformUtil {
 #ifdef _WINDOWS
 // ACP wide to multibyte
@@ -35,7 +46,7 @@ void OpenFileStream(std::fstream& file, const std::string& fileName, unsigned in
 	// Convert to std::wstring on Windows only
 	file.open(MultiByteToWideUTF8(fileName).c_str(), mode);
 #else
-	file.open(fileName.c_str(), mode);
+	file.open(fileName.c_str(), static_cast<std::ios_base::openmode>(mode));
 #endif
 }
 
@@ -45,4 +56,161 @@ void OpenFileStream(std::fstream& file, const std::wstring& fileName, unsigned i
 	file.open(fileName.c_str(), mode);
 }
 #endif
+
+bool ReadFile(const std::string& fileName, std::vector<char>& data) {
+	std::fstream file;
+	OpenFileStream(file, fileName, std::ios::in | std::ios::binary | std::ios::ate);
+	if (!file)
+		return false;
+
+	std::streamoff size = file.tellg();
+	if (size < 0)
+		return false;
+
+	data.resize(static_cast<size_t>(size));
+	file.seekg(0);
+	file.read(data.data(), size);
+	return !file.fail();
+}
+
+bool WriteFile(const std::string& fileName, const char* data, size_t size) {
+	std::fstream file;
+	OpenFileStream(file, fileName, std::ios::out | std::ios::binary);
+	if (!file)
+		return false;
+
+	file.write(data, size);
+	file.close();
+	return !file.fail();
+}
+
+bool WriteNewFile(const std::string& fileName, const char* data, size_t size, bool sync) {
+#ifdef _WINDOWS
+	HANDLE file = CreateFileW(MultiByteToWideUTF8(fileName).c_str(),
+							  GENERIC_WRITE,
+							  0,
+							  nullptr,
+							  CREATE_ALWAYS,
+							  FILE_ATTRIBUTE_NORMAL,
+							  nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	// WriteFile takes 32-bit sizes
+	bool success = true;
+	while (success && size > 0) {
+		DWORD chunk = static_cast<DWORD>(std::min<size_t>(size, 0x40000000));
+		DWORD written = 0;
+		success = ::WriteFile(file, data, chunk, &written, nullptr) && written > 0;
+		data += written;
+		size -= written;
+	}
+
+	if (success && sync)
+		success = FlushFileBuffers(file) != FALSE;
+
+	return CloseHandle(file) != FALSE && success;
+#else
+	int file = open(fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+	if (file < 0)
+		return false;
+
+	bool success = true;
+	while (success && size > 0) {
+		ssize_t written = write(file, data, size);
+		if (written < 0 && errno == EINTR)
+			continue;
+
+		success = written > 0;
+		if (success) {
+			data += written;
+			size -= static_cast<size_t>(written);
+		}
+	}
+
+	if (success && sync)
+		success = fsync(file) == 0;
+
+	return close(file) == 0 && success;
+#endif
+}
+
+std::string GetTempFileName(const std::string& fileName) {
+	static std::atomic<uint64_t> counter{0};
+
+#ifdef _WINDOWS
+	unsigned long processId = GetCurrentProcessId();
+#else
+	unsigned long processId = static_cast<unsigned long>(getpid());
+#endif
+
+	// Other processes and threads writing beside the same file get their own names
+	return fileName + "." + std::to_string(processId) + "-" + std::to_string(counter++) + ".tmp";
+}
+
+bool SyncFile(const std::string& fileName) {
+#ifdef _WINDOWS
+	HANDLE file = CreateFileW(MultiByteToWideUTF8(fileName).c_str(),
+							  GENERIC_WRITE,
+							  FILE_SHARE_READ | FILE_SHARE_WRITE,
+							  nullptr,
+							  OPEN_EXISTING,
+							  FILE_ATTRIBUTE_NORMAL,
+							  nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	bool success = FlushFileBuffers(file) != FALSE;
+	return CloseHandle(file) != FALSE && success;
+#else
+	int file = open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+	if (file < 0)
+		return false;
+
+	bool success = fsync(file) == 0;
+	return close(file) == 0 && success;
+#endif
+}
+
+bool SyncDirectory(const std::string& folder) {
+#ifdef _WINDOWS
+	return true;
+#else
+	int dir = open(folder.empty() ? "." : folder.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (dir < 0)
+		return false;
+
+	bool success = fsync(dir) == 0;
+	return close(dir) == 0 && success;
+#endif
+}
+
+bool RenameFile(const std::string& source, const std::string& target, bool sync) {
+#ifdef _WINDOWS
+	DWORD flags = MOVEFILE_REPLACE_EXISTING;
+	if (sync)
+		flags |= MOVEFILE_WRITE_THROUGH;
+
+	std::wstring sourceW = MultiByteToWideUTF8(source);
+	std::wstring targetW = MultiByteToWideUTF8(target);
+	return MoveFileExW(sourceW.c_str(), targetW.c_str(), flags) != FALSE;
+#else
+	// The new file keeps the owner, group and permissions of the one it replaces. Changing the owner takes
+	// privileges the process may not have, then it stays with the user running it.
+	struct stat targetStat;
+	if (stat(target.c_str(), &targetStat) == 0) {
+		if (chown(source.c_str(), targetStat.st_uid, targetStat.st_gid) != 0)
+			chown(source.c_str(), static_cast<uid_t>(-1), targetStat.st_gid);
+		chmod(source.c_str(), targetStat.st_mode & 07777);
+	}
+
+	if (rename(source.c_str(), target.c_str()) != 0)
+		return false;
+
+	if (sync)
+		return SyncDirectory(std::filesystem::u8path(target).parent_path().u8string());
+
+	return true;
+#endif
+}
 } // namespace PlatformUtil
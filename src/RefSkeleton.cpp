@@ -0,0 +1,281 @@
+/*
+SSE NIF Optimizer
+See the included LICENSE file
+*/
+
+#include "RefSkeleton.hpp"
+#include "FileView.hpp"
+#include "Hash.hpp"
+#include "Manifest.hpp"
+#include "MemoryStream.hpp"
+#include "PlatformUtil.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <type_traits>
+
+using namespace nifly;
+
+namespace {
+// Cache layout: header, bone records, bone names without terminators, hash of everything before it.
+// Transforms are copied as they are in memory, the cache is only meant for the machine that wrote it.
+constexpr char CacheMagic[4] = {'N', 'O', 'S', 'K'};
+constexpr uint32_t CacheVersion = 2;
+
+static_assert(std::is_trivially_copyable<MatTransform>::value, "Transforms are copied byte by byte");
+
+struct CacheHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t transformSize;
+	uint32_t boneCount;
+	uint64_t sourceSize;
+	int64_t sourceTime;
+	uint64_t sourceHash;
+	uint64_t namesSize;
+};
+
+struct CacheBone {
+	int32_t parent;
+	uint32_t nameOffset;
+	uint32_t nameLength;
+	MatTransform xformToParent;
+};
+} // namespace
+
+std::shared_ptr<const RefSkeleton> RefSkeleton::Get(const std::string& fileName,
+													const std::string& cacheFileName) {
+	struct Loaded {
+		std::shared_ptr<const RefSkeleton> skeleton;
+		uint64_t sourceSize = 0;
+		int64_t sourceTime = 0;
+	};
+
+	static std::mutex mutex;
+	static std::unordered_map<std::string, Loaded> skeletons;
+
+	uint64_t sourceSize = 0;
+	int64_t sourceTime = 0;
+	Manifest::GetFileStatus(fileName, sourceSize, sourceTime);
+
+	// Failures are remembered as well, so that a broken skeleton isn't parsed again for every file
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it = skeletons.find(fileName);
+	if (it != skeletons.end() && it->second.sourceSize == sourceSize && it->second.sourceTime == sourceTime)
+		return it->second.skeleton;
+
+	auto skeleton = Load(fileName, cacheFileName);
+	skeletons[fileName] = {skeleton, sourceSize, sourceTime};
+	return skeleton;
+}
+
+std::shared_ptr<const RefSkeleton> RefSkeleton::Load(const std::string& fileName,
+													 const std::string& cacheFileName) {
+	uint64_t sourceSize = 0;
+	int64_t sourceTime = 0;
+	if (!Manifest::GetFileStatus(fileName, sourceSize, sourceTime))
+		return nullptr;
+
+	if (!cacheFileName.empty()) {
+		auto skeleton = std::make_shared<RefSkeleton>();
+		skeleton->sourceSize = sourceSize;
+		skeleton->sourceTime = sourceTime;
+		if (skeleton->LoadCache(cacheFileName)) {
+			skeleton->fromCache = true;
+			return skeleton;
+		}
+	}
+
+	auto parsed = LoadFromNif(fileName);
+	if (!parsed)
+		return nullptr;
+
+	// The cache folder may well be read-only, the cache is only an optimization
+	if (!cacheFileName.empty())
+		parsed->SaveCache(cacheFileName);
+	return parsed;
+}
+
+std::shared_ptr<const RefSkeleton> RefSkeleton::LoadFromNif(const std::string& fileName) {
+	FileView input;
+	if (!input.Open(fileName))
+		return nullptr;
+
+	MemoryInputBuf inBuf(input.GetData(), input.GetSize());
+	std::istream inStream(&inBuf);
+
+	NifFile nif;
+	if (nif.Load(inStream) != 0)
+		return nullptr;
+
+	NiNode* root = nif.GetRootNode();
+	if (!root)
+		return nullptr;
+
+	auto skeleton = std::make_shared<RefSkeleton>();
+	Manifest::GetFileStatus(fileName, skeleton->sourceSize, skeleton->sourceTime);
+	skeleton->sourceHash = HashBytes(input.GetData(), input.GetSize());
+	int unnamedCount = 0;
+
+	// Depth-first, so that parents are added before their children
+	std::vector<std::pair<NiNode*, int>> stack;
+	stack.emplace_back(root, -1);
+
+	while (!stack.empty()) {
+		NiNode* node = stack.back().first;
+		int parent = stack.back().second;
+		stack.pop_back();
+
+		std::string name = node->name.get();
+		if (name.empty())
+			continue;
+
+		if (name == "_unnamed_")
+			name = "UnnamedBone_" + std::to_string(unnamedCount++);
+
+		if (!skeleton->AddBone(name, parent, node->GetTransformToParent()))
+			continue;
+
+		int index = static_cast<int>(skeleton->bones.size()) - 1;
+		for (auto it = node->childRefs.rbegin(); it != node->childRefs.rend(); ++it) {
+			NiNode* child = nif.GetHeader().GetBlock<NiNode>(it->index);
+			if (child)
+				stack.emplace_back(child, index);
+		}
+	}
+
+	if (skeleton->bones.empty())
+		return nullptr;
+
+	return skeleton;
+}
+
+std::string RefSkeleton::GetCacheFileName(const std::string& fileName, const std::string& manifestPath) {
+	// One cache per skeleton path
+	char pathHash[17];
+	unsigned long long hash = HashString(fileName);
+	std::snprintf(pathHash, sizeof(pathHash), "%016llx", hash);
+	return manifestPath + "." + pathHash + ".skeleton";
+}
+
+int RefSkeleton::FindBone(const std::string& name) const {
+	auto it = boneIndices.find(name);
+	return it != boneIndices.end() ? it->second : -1;
+}
+
+bool RefSkeleton::AddBone(const std::string& name, int parent, const MatTransform& xformToParent) {
+	// Only the first bone of a name counts, like in a name lookup of the NIF
+	if (!boneIndices.emplace(name, static_cast<int>(bones.size())).second)
+		return false;
+
+	Bone bone;
+	bone.name = name;
+	bone.parent = parent;
+	bone.xformToParent = xformToParent;
+	bone.xformToGlobal = parent >= 0 ? bones[parent].xformToGlobal.ComposeTransforms(xformToParent)
+									 : xformToParent;
+
+	bones.push_back(std::move(bone));
+	return true;
+}
+
+bool RefSkeleton::LoadCache(const std::string& cacheFileName) {
+	FileView input;
+	if (!input.Open(cacheFileName))
+		return false;
+
+	const char* data = input.GetData();
+	size_t size = input.GetSize();
+
+	CacheHeader header;
+	uint64_t storedHash = 0;
+	if (size < sizeof(header) + sizeof(storedHash))
+		return false;
+
+	std::memcpy(&header, data, sizeof(header));
+	if (std::memcmp(header.magic, CacheMagic, sizeof(CacheMagic)) != 0 || header.version != CacheVersion
+		|| header.transformSize != sizeof(MatTransform) || header.sourceSize != sourceSize
+		|| header.sourceTime != sourceTime)
+		return false;
+
+	uint64_t recordsSize = static_cast<uint64_t>(header.boneCount) * sizeof(CacheBone);
+	if (sizeof(header) + recordsSize + header.namesSize + sizeof(storedHash) != size)
+		return false;
+
+	size_t hashedSize = size - sizeof(storedHash);
+	std::memcpy(&storedHash, data + hashedSize, sizeof(storedHash));
+	if (HashBytes(data, hashedSize) != storedHash)
+		return false;
+
+	const char* records = data + sizeof(header);
+	const char* names = records + recordsSize;
+	sourceHash = header.sourceHash;
+
+	bones.reserve(header.boneCount);
+	boneIndices.reserve(header.boneCount);
+
+	for (uint32_t i = 0; i < header.boneCount; i++) {
+		CacheBone record;
+		std::memcpy(&record, records + i * sizeof(CacheBone), sizeof(record));
+
+		if (record.parent >= static_cast<int32_t>(i) || record.parent < -1
+			|| static_cast<uint64_t>(record.nameOffset) + record.nameLength > header.namesSize
+			|| !AddBone(std::string(names + record.nameOffset, record.nameLength),
+						record.parent,
+						record.xformToParent)) {
+			bones.clear();
+			boneIndices.clear();
+			return false;
+		}
+	}
+
+	return !bones.empty();
+}
+
+bool RefSkeleton::SaveCache(const std::string& cacheFileName) const {
+	CacheHeader header{};
+	std::memcpy(header.magic, CacheMagic, sizeof(CacheMagic));
+	header.version = CacheVersion;
+	header.transformSize = sizeof(MatTransform);
+	header.boneCount = static_cast<uint32_t>(bones.size());
+	header.sourceSize = sourceSize;
+	header.sourceTime = sourceTime;
+	header.sourceHash = sourceHash;
+
+	std::string names;
+	std::vector<CacheBone> records(bones.size());
+	for (size_t i = 0; i < bones.size(); i++) {
+		records[i].parent = bones[i].parent;
+		records[i].nameOffset = static_cast<uint32_t>(names.size());
+		records[i].nameLength = static_cast<uint32_t>(bones[i].name.size());
+		records[i].xformToParent = bones[i].xformToParent;
+		names += bones[i].name;
+	}
+
+	header.namesSize = names.size();
+
+	size_t recordsSize = records.size() * sizeof(CacheBone);
+	size_t hashedSize = sizeof(header) + recordsSize + names.size();
+
+	std::vector<char> data(hashedSize + sizeof(uint64_t));
+	std::memcpy(data.data(), &header, sizeof(header));
+	if (recordsSize > 0)
+		std::memcpy(data.data() + sizeof(header), records.data(), recordsSize);
+	if (!names.empty())
+		std::memcpy(data.data() + sizeof(header) + recordsSize, names.data(), names.size());
+
+	uint64_t hash = HashBytes(data.data(), hashedSize);
+	std::memcpy(data.data() + hashedSize, &hash, sizeof(hash));
+
+	// Written beside and renamed, so that other processes never see half a cache
+	std::string tempFileName = PlatformUtil::GetTempFileName(cacheFileName);
+	if (PlatformUtil::WriteNewFile(tempFileName, data.data(), data.size())
+		&& PlatformUtil::RenameFile(tempFileName, cacheFileName))
+		return true;
+
+	std::error_code ec;
+	std::filesystem::remove(std::filesystem::u8path(tempFileName), ec);
+	return false;
+}
@@ -0,0 +1,239 @@
+/*
+SSE NIF Optimizer
+See the included LICENSE file
+*/
+
+#include "SkinWeights.hpp"
+
+#include <algorithm>
+#include <utility>
+
+void SkinWeights::Clear() {
+	rowStart.assign(1, 0);
+	vertices.clear();
+	weights.clear();
+}
+
+SkinWeights::BoneRow SkinWeights::GetBone(size_t bone) const {
+	BoneRow row;
+	if (bone >= GetBoneCount())
+		return row;
+
+	row.vertices = vertices.data() + rowStart[bone];
+	row.weights = weights.data() + rowStart[bone];
+	row.size = rowStart[bone + 1] - rowStart[bone];
+	return row;
+}
+
+void SkinWeights::GetBone(size_t bone, std::unordered_map<uint16_t, float>& outWeights) const {
+	BoneRow row = GetBone(bone);
+
+	outWeights.clear();
+	outWeights.reserve(row.size);
+	for (size_t i = 0; i < row.size; i++)
+		outWeights.emplace(row.vertices[i], row.weights[i]);
+}
+
+bool SkinWeights::HasInfluence(size_t bone) const {
+	BoneRow row = GetBone(bone);
+	return std::any_of(row.weights, row.weights + row.size, [](float weight) { return weight > 0.0f; });
+}
+
+size_t SkinWeights::GetVertexEnd() const {
+	// Rows are sorted, so only the last vertex of each one matters
+	size_t end = 0;
+	for (size_t bone = 0; bone < GetBoneCount(); bone++) {
+		if (rowStart[bone + 1] > rowStart[bone])
+			end = std::max<size_t>(end, vertices[rowStart[bone + 1] - 1] + 1);
+	}
+
+	return end;
+}
+
+void SkinWeights::SetFromVertices(size_t boneCount,
+								  size_t vertexCount,
+								  size_t slotCount,
+								  const uint8_t* slotBones,
+								  const float* slotWeights,
+								  size_t stride) {
+	auto bonesOf = [&](size_t v) {
+		return reinterpret_cast<const uint8_t*>(reinterpret_cast<const char*>(slotBones) + v * stride);
+	};
+	auto weightsOf = [&](size_t v) {
+		return reinterpret_cast<const float*>(reinterpret_cast<const char*>(slotWeights) + v * stride);
+	};
+
+	// A bone only counts with the first slot that gives it a weight
+	auto isUsed = [&](const uint8_t* b, const float* w, size_t slot) {
+		if (w[slot] == 0.0f || b[slot] >= boneCount)
+			return false;
+
+		for (size_t prev = 0; prev < slot; prev++)
+			if (b[prev] == b[slot] && w[prev] != 0.0f)
+				return false;
+
+		return true;
+	};
+
+	// Counting sort by bone, vertices come out in order within each row
+	rowStart.assign(boneCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; v++) {
+		const uint8_t* b = bonesOf(v);
+		const float* w = weightsOf(v);
+		for (size_t slot = 0; slot < slotCount; slot++)
+			if (isUsed(b, w, slot))
+				rowStart[b[slot] + 1]++;
+	}
+
+	for (size_t bone = 0; bone < boneCount; bone++)
+		rowStart[bone + 1] += rowStart[bone];
+
+	vertices.resize(rowStart.back());
+	weights.resize(rowStart.back());
+
+	std::vector<uint32_t> next(rowStart.begin(), rowStart.end() - 1);
+	for (size_t v = 0; v < vertexCount; v++) {
+		const uint8_t* b = bonesOf(v);
+		const float* w = weightsOf(v);
+		for (size_t slot = 0; slot < slotCount; slot++) {
+			if (!isUsed(b, w, slot))
+				continue;
+
+			uint32_t index = next[b[slot]]++;
+			vertices[index] = static_cast<uint16_t>(v);
+			weights[index] = w[slot];
+		}
+	}
+}
+
+void SkinWeights::AddBone(const std::unordered_map<uint16_t, float>& boneWeights) {
+	for (auto& weight : boneWeights) {
+		vertices.push_back(weight.first);
+		weights.push_back(weight.second);
+	}
+
+	rowStart.push_back(static_cast<uint32_t>(vertices.size()));
+	SortRange(rowStart[GetBoneCount() - 1], rowStart.back());
+}
+
+void SkinWeights::SetBone(size_t bone, const std::unordered_map<uint16_t, float>& boneWeights) {
+	while (GetBoneCount() <= bone)
+		rowStart.push_back(rowStart.back());
+
+	uint32_t start = rowStart[bone];
+	uint32_t oldSize = rowStart[bone + 1] - start;
+	uint32_t newSize = static_cast<uint32_t>(boneWeights.size());
+
+	vertices.erase(vertices.begin() + start, vertices.begin() + start + oldSize);
+	weights.erase(weights.begin() + start, weights.begin() + start + oldSize);
+	vertices.insert(vertices.begin() + start, newSize, 0);
+	weights.insert(weights.begin() + start, newSize, 0.0f);
+
+	uint32_t index = start;
+	for (auto& weight : boneWeights) {
+		vertices[index] = weight.first;
+		weights[index] = weight.second;
+		index++;
+	}
+
+	for (size_t b = bone + 1; b < rowStart.size(); b++)
+		rowStart[b] = rowStart[b] - oldSize + newSize;
+
+	SortRange(start, start + newSize);
+}
+
+void SkinWeights::RemoveBone(size_t bone) {
+	if (bone >= GetBoneCount())
+		return;
+
+	uint32_t start = rowStart[bone];
+	uint32_t size = rowStart[bone + 1] - start;
+
+	vertices.erase(vertices.begin() + start, vertices.begin() + start + size);
+	weights.erase(weights.begin() + start, weights.begin() + start + size);
+	rowStart.erase(rowStart.begin() + bone + 1);
+
+	for (size_t b = bone + 1; b < rowStart.size(); b++)
+		rowStart[b] -= size;
+}
+
+void SkinWeights::RemapBones(const std::vector<int>& boneMap) {
+	// Rows are only moved down, so the matrix can be compacted in place
+	uint32_t write = 0;
+	uint32_t start = 0;
+	size_t newBoneCount = 0;
+	for (size_t bone = 0; bone < GetBoneCount(); bone++) {
+		uint32_t end = rowStart[bone + 1];
+		if (bone < boneMap.size() && boneMap[bone] < 0) {
+			start = end;
+			continue;
+		}
+
+		rowStart[newBoneCount++] = write;
+		for (uint32_t i = start; i < end; i++, write++) {
+			vertices[write] = vertices[i];
+			weights[write] = weights[i];
+		}
+
+		start = end;
+	}
+
+	rowStart[newBoneCount] = write;
+	rowStart.resize(newBoneCount + 1);
+	vertices.resize(write);
+	weights.resize(write);
+}
+
+void SkinWeights::RemapVertices(const std::vector<int>& indexMap, int mapEndOffset) {
+	const int mapEnd = static_cast<int>(indexMap.size());
+
+	// Compacts in place, rows only ever shrink
+	uint32_t write = 0;
+	uint32_t start = 0;
+	for (size_t bone = 0; bone < GetBoneCount(); bone++) {
+		uint32_t end = rowStart[bone + 1];
+		uint32_t newStart = write;
+		rowStart[bone] = newStart;
+
+		bool sorted = true;
+		for (uint32_t i = start; i < end; i++) {
+			int vertex = vertices[i];
+			int mapped = vertex >= mapEnd ? vertex + mapEndOffset : indexMap[vertex];
+			if (mapped < 0 || mapped > UINT16_MAX)
+				continue;
+
+			if (write > newStart && vertices[write - 1] >= mapped)
+				sorted = false;
+
+			vertices[write] = static_cast<uint16_t>(mapped);
+			weights[write] = weights[i];
+			write++;
+		}
+
+		if (!sorted)
+			SortRange(newStart, write);
+
+		start = end;
+	}
+
+	rowStart.back() = write;
+	vertices.resize(write);
+	weights.resize(write);
+}
+
+void SkinWeights::SortRange(uint32_t start, uint32_t end) {
+	if (std::is_sorted(vertices.begin() + start, vertices.begin() + end))
+		return;
+
+	std::vector<std::pair<uint16_t, float>> row;
+	row.reserve(end - start);
+	for (uint32_t i = start; i < end; i++)
+		row.emplace_back(vertices[i], weights[i]);
+
+	std::sort(row.begin(), row.end(), [](auto& a, auto& b) { return a.first < b.first; });
+
+	for (uint32_t i = start; i < end; i++) {
+		vertices[i] = row[i - start].first;
+		weights[i] = row[i - start].second;
+	}
+}
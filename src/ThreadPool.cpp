@@ -0,0 +1,105 @@
+/*
+SSE NIF Optimizer
+See the included LICENSE file
+*/
+
+#include "ThreadPool.hpp"
+
+namespace {
+thread_local const ThreadPool* workerPool = nullptr;
+thread_local int workerIndex = -1;
+} // namespace
+
+ThreadPool::ThreadPool(size_t threadCount) {
+	if (threadCount == 0)
+		threadCount = std::thread::hardware_concurrency();
+	if (threadCount == 0)
+		threadCount = 1;
+
+	for (size_t i = 0; i < threadCount; i++)
+		queues.push_back(std::make_unique<WorkQueue>());
+
+	for (size_t i = 0; i < threadCount; i++)
+		workers.emplace_back(&ThreadPool::WorkerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(wakeMutex);
+		stopping = true;
+	}
+
+	wakeCondition.notify_all();
+
+	for (auto& worker : workers)
+		worker.join();
+}
+
+int ThreadPool::GetWorkerIndex() {
+	return workerIndex;
+}
+
+void ThreadPool::Push(std::function<void()> task) {
+	// Tasks submitted by a worker stay on its own queue, others are spread round-robin
+	size_t index = workerPool == this ? static_cast<size_t>(workerIndex) : nextQueue++ % queues.size();
+
+	// Counted before it's visible, so that a Pop or Steal of it never takes the count below zero
+	{
+		std::lock_guard<std::mutex> lock(wakeMutex);
+		pendingCount++;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(queues[index]->mutex);
+		queues[index]->tasks.push_back(std::move(task));
+	}
+
+	wakeCondition.notify_one();
+}
+
+bool ThreadPool::Pop(size_t index, std::function<void()>& task) {
+	auto& queue = *queues[index];
+	std::lock_guard<std::mutex> lock(queue.mutex);
+	if (queue.tasks.empty())
+		return false;
+
+	task = std::move(queue.tasks.front());
+	queue.tasks.pop_front();
+	pendingCount--;
+	return true;
+}
+
+bool ThreadPool::Steal(size_t index, std::function<void()>& task) {
+	for (size_t i = 1; i < queues.size(); i++) {
+		auto& queue = *queues[(index + i) % queues.size()];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.tasks.empty())
+			continue;
+
+		task = std::move(queue.tasks.back());
+		queue.tasks.pop_back();
+		pendingCount--;
+		return true;
+	}
+
+	return false;
+}
+
+void ThreadPool::WorkerLoop(size_t index) {
+	workerPool = this;
+	workerIndex = static_cast<int>(index);
+
+	while (true) {
+		std::function<void()> task;
+		if (Pop(index, task) || Steal(index, task)) {
+			task();
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(wakeMutex);
+		wakeCondition.wait(lock, [this]() { return stopping || pendingCount > 0; });
+
+		if (stopping && pendingCount == 0)
+			break;
+	}
+}
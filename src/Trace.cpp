@@ -0,0 +1,197 @@
+/*
+SSE NIF Optimizer
+See the included LICENSE file
+*/
+
+#include "Trace.hpp"
+#include "Arena.hpp"
+#include "Json.hpp"
+#include "PlatformUtil.hpp"
+#include "ThreadPool.hpp"
+
+#include <atomic>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+struct TraceEvent {
+	const char* name = nullptr;
+	const char* category = nullptr;
+	std::string path;
+	Trace::Clock::time_point start;
+	Trace::Clock::time_point end;
+};
+
+// Events of one thread. The mutex is only contended while the trace is being written.
+struct ThreadBuffer {
+	int threadId = 0;
+	std::string threadName;
+	std::mutex mutex;
+	std::vector<TraceEvent> events;
+};
+
+struct TraceSession {
+	std::atomic<bool> enabled{false};
+	std::atomic<uint32_t> generation{0};
+	Trace::Clock::time_point startTime;
+
+	std::mutex mutex;
+	std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+};
+
+TraceSession& GetSession() {
+	static TraceSession session;
+	return session;
+}
+
+thread_local std::string threadName;
+thread_local std::shared_ptr<ThreadBuffer> threadBuffer;
+thread_local uint32_t threadGeneration = 0;
+
+ThreadBuffer& GetThreadBuffer() {
+	TraceSession& session = GetSession();
+
+	// Buffers of a previous trace aren't reused
+	uint32_t generation = session.generation;
+	if (!threadBuffer || threadGeneration != generation) {
+		threadBuffer = std::make_shared<ThreadBuffer>();
+		threadGeneration = generation;
+
+		std::lock_guard<std::mutex> lock(session.mutex);
+		threadBuffer->threadId = static_cast<int>(session.buffers.size()) + 1;
+
+		if (!threadName.empty())
+			threadBuffer->threadName = threadName;
+		else if (ThreadPool::GetWorkerIndex() >= 0)
+			threadBuffer->threadName = "Worker " + std::to_string(ThreadPool::GetWorkerIndex());
+		else
+			threadBuffer->threadName = "Thread " + std::to_string(threadBuffer->threadId);
+
+		session.buffers.push_back(threadBuffer);
+	}
+
+	return *threadBuffer;
+}
+
+int64_t ToMicroseconds(Trace::Clock::duration duration) {
+	return std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+}
+
+std::string GetFileName(const std::string& path) {
+	size_t pos = path.find_last_of("/\\");
+	return pos == std::string::npos ? path : path.substr(pos + 1);
+}
+} // namespace
+
+void Trace::Start() {
+	TraceSession& session = GetSession();
+
+	std::lock_guard<std::mutex> lock(session.mutex);
+	session.buffers.clear();
+	session.generation++;
+	session.startTime = Clock::now();
+	session.enabled = true;
+}
+
+bool Trace::Stop(const std::string& fileName) {
+	TraceSession& session = GetSession();
+	session.enabled = false;
+
+	std::lock_guard<std::mutex> lock(session.mutex);
+
+	std::fstream file;
+	PlatformUtil::OpenFileStream(file, fileName, std::ios::out | std::ios::binary);
+	if (!file) {
+		session.buffers.clear();
+		return false;
+	}
+
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"SSE NIF Optimizer\"}}";
+
+	for (auto& buffer : session.buffers) {
+		std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+
+		file << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->threadId
+			 << ",\"args\":{\"name\":" << QuoteJson(buffer->threadName) << "}}";
+
+		for (auto& event : buffer->events) {
+			std::string name = event.name ? event.name : GetFileName(event.path);
+
+			file << ",\n{\"name\":" << QuoteJson(name) << ",\"cat\":\"" << event.category
+				 << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->threadId
+				 << ",\"ts\":" << ToMicroseconds(event.start - session.startTime)
+				 << ",\"dur\":" << ToMicroseconds(event.end - event.start);
+
+			if (!event.path.empty())
+				file << ",\"args\":{\"path\":" << QuoteJson(event.path) << "}";
+
+			file << "}";
+		}
+	}
+
+	file << "\n]}\n";
+	file.close();
+
+	session.buffers.clear();
+	return !file.fail();
+}
+
+bool Trace::IsEnabled() {
+	return GetSession().enabled.load(std::memory_order_relaxed);
+}
+
+void Trace::SetThreadName(const std::string& name) {
+	threadName = name;
+}
+
+void Trace::AddSpan(const char* name, const char* category, Clock::time_point start, Clock::time_point end) {
+	if (!IsEnabled())
+		return;
+
+	// Events outlive the file that's being processed
+	ArenaPause pause;
+
+	ThreadBuffer& buffer = GetThreadBuffer();
+	std::lock_guard<std::mutex> lock(buffer.mutex);
+	buffer.events.push_back({name, category, std::string(), start, end});
+}
+
+void Trace::AddFileSpan(const std::string& path, Clock::time_point start, Clock::time_point end) {
+	if (!IsEnabled())
+		return;
+
+	ArenaPause pause;
+
+	ThreadBuffer& buffer = GetThreadBuffer();
+	std::lock_guard<std::mutex> lock(buffer.mutex);
+	buffer.events.push_back({nullptr, "file", path, start, end});
+}
+
+TraceSpan::TraceSpan(const char* name, const char* category)
+	: enabled(Trace::IsEnabled())
+	, name(name)
+	, category(category) {
+	if (enabled)
+		start = Trace::Clock::now();
+}
+
+TraceSpan::TraceSpan(const std::string& path)
+	: enabled(Trace::IsEnabled()) {
+	if (enabled) {
+		this->path = path;
+		start = Trace::Clock::now();
+	}
+}
+
+TraceSpan::~TraceSpan() {
+	if (!enabled)
+		return;
+
+	if (name)
+		Trace::AddSpan(name, category, start, Trace::Clock::now());
+	else
+		Trace::AddFileSpan(path, start, Trace::Clock::now());
+}
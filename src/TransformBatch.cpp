@@ -0,0 +1,236 @@
+/*
+SSE NIF Optimizer
+See the included LICENSE file
+*/
+
+#include "TransformBatch.hpp"
+#include "TransformKernels.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NIFOPT_HAS_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+using namespace nifly;
+
+static_assert(TransformArray::StreamCount == TransformKernels::TransformStreamCount);
+static_assert(VectorArray::StreamCount == TransformKernels::VectorStreamCount);
+
+namespace {
+size_t PaddedStride(size_t count) {
+	return (count + TransformArray::Padding - 1) / TransformArray::Padding * TransformArray::Padding;
+}
+
+// Copies the streams of the old storage that fit into new storage filled with the default values
+template<size_t StreamCount>
+void ResizeStreams(std::vector<float>& data,
+				   size_t& size,
+				   size_t& stride,
+				   size_t count,
+				   const float* defaults) {
+	size_t newStride = PaddedStride(count);
+	std::vector<float> newData(StreamCount * newStride);
+	for (size_t s = 0; s < StreamCount; s++) {
+		float* stream = newData.data() + s * newStride;
+		std::fill(stream, stream + newStride, defaults[s]);
+		if (!data.empty())
+			std::copy_n(data.data() + s * stride, std::min(size, count), stream);
+	}
+
+	data.swap(newData);
+	size = count;
+	stride = newStride;
+}
+
+#ifdef NIFOPT_HAS_SSE2
+struct SseLane {
+	static constexpr size_t Width = 4;
+	__m128 v;
+
+	static SseLane Load(const float* p) { return {_mm_loadu_ps(p)}; }
+	static SseLane Set(float f) { return {_mm_set1_ps(f)}; }
+	void Store(float* p) const { _mm_storeu_ps(p, v); }
+
+	friend SseLane operator+(SseLane a, SseLane b) { return {_mm_add_ps(a.v, b.v)}; }
+	friend SseLane operator-(SseLane a, SseLane b) { return {_mm_sub_ps(a.v, b.v)}; }
+	friend SseLane operator*(SseLane a, SseLane b) { return {_mm_mul_ps(a.v, b.v)}; }
+	friend SseLane operator/(SseLane a, SseLane b) { return {_mm_div_ps(a.v, b.v)}; }
+};
+#endif
+
+// The AVX2 kernels are only used if the CPU and the OS support them
+bool CpuSupportsAvx2() {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+
+	// AVX and OSXSAVE, then the OS has to save the YMM registers
+	__cpuid(info, 1);
+	if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0)
+		return false;
+	if ((_xgetbv(0) & 6) != 6)
+		return false;
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+	return __builtin_cpu_supports("avx2");
+#else
+	return false;
+#endif
+}
+
+const TransformKernels::KernelTable& GetKernels(TransformKernel kernel) {
+	switch (kernel) {
+		case TransformKernel::AVX2:
+			if (TransformBatch::IsSupported(kernel))
+				return *TransformKernels::GetAvx2Kernels();
+			[[fallthrough]];
+		case TransformKernel::SSE2:
+#ifdef NIFOPT_HAS_SSE2
+			return TransformKernels::GetKernels<SseLane>();
+#endif
+		default: return TransformKernels::GetKernels<TransformKernels::ScalarLane>();
+	}
+}
+
+template<typename Array, size_t StreamCount = Array::StreamCount>
+std::array<const float*, StreamCount> GetStreams(const Array& arr) {
+	std::array<const float*, StreamCount> streams;
+	for (size_t s = 0; s < StreamCount; s++)
+		streams[s] = arr.GetStream(s);
+	return streams;
+}
+
+template<typename Array, size_t StreamCount = Array::StreamCount>
+std::array<float*, StreamCount> GetStreams(Array& arr) {
+	std::array<float*, StreamCount> streams;
+	for (size_t s = 0; s < StreamCount; s++)
+		streams[s] = arr.GetStream(s);
+	return streams;
+}
+} // namespace
+
+void TransformArray::Resize(size_t count) {
+	if (count == size && !data.empty())
+		return;
+
+	static constexpr float identity[StreamCount] = {
+		1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f};
+	ResizeStreams<StreamCount>(data, size, stride, count, identity);
+}
+
+void TransformArray::Set(size_t index, const MatTransform& xform) {
+	for (size_t r = 0; r < 3; r++) {
+		const Vector3& row = xform.rotation[static_cast<int>(r)];
+		GetStream(r * 3)[index] = row.x;
+		GetStream(r * 3 + 1)[index] = row.y;
+		GetStream(r * 3 + 2)[index] = row.z;
+	}
+
+	GetStream(9)[index] = xform.translation.x;
+	GetStream(10)[index] = xform.translation.y;
+	GetStream(11)[index] = xform.translation.z;
+	GetStream(12)[index] = xform.scale;
+}
+
+MatTransform TransformArray::Get(size_t index) const {
+	MatTransform xform;
+	for (size_t r = 0; r < 3; r++) {
+		Vector3& row = xform.rotation[static_cast<int>(r)];
+		row.x = GetStream(r * 3)[index];
+		row.y = GetStream(r * 3 + 1)[index];
+		row.z = GetStream(r * 3 + 2)[index];
+	}
+
+	xform.translation = Vector3(GetStream(9)[index], GetStream(10)[index], GetStream(11)[index]);
+	xform.scale = GetStream(12)[index];
+	return xform;
+}
+
+void VectorArray::Resize(size_t count) {
+	if (count == size && !data.empty())
+		return;
+
+	static constexpr float zero[StreamCount] = {};
+	ResizeStreams<StreamCount>(data, size, stride, count, zero);
+}
+
+void VectorArray::Set(size_t index, const Vector3& vec) {
+	GetStream(0)[index] = vec.x;
+	GetStream(1)[index] = vec.y;
+	GetStream(2)[index] = vec.z;
+}
+
+Vector3 VectorArray::Get(size_t index) const {
+	return Vector3(GetStream(0)[index], GetStream(1)[index], GetStream(2)[index]);
+}
+
+namespace TransformBatch {
+TransformKernel GetBestKernel() {
+	static const TransformKernel best = IsSupported(TransformKernel::AVX2)   ? TransformKernel::AVX2
+										: IsSupported(TransformKernel::SSE2) ? TransformKernel::SSE2
+																			 : TransformKernel::Scalar;
+	return best;
+}
+
+bool IsSupported(TransformKernel kernel) {
+	switch (kernel) {
+		case TransformKernel::AVX2: {
+			static const bool supported = TransformKernels::GetAvx2Kernels() && CpuSupportsAvx2();
+			return supported;
+		}
+		case TransformKernel::SSE2:
+#ifdef NIFOPT_HAS_SSE2
+			return true;
+#else
+			return false;
+#endif
+		default: return true;
+	}
+}
+
+const char* GetKernelName(TransformKernel kernel) {
+	switch (kernel) {
+		case TransformKernel::AVX2: return "AVX2";
+		case TransformKernel::SSE2: return "SSE2";
+		default: return "Scalar";
+	}
+}
+
+void ComposeTransforms(const TransformArray& a,
+					   const TransformArray& b,
+					   TransformArray& out,
+					   TransformKernel kernel) {
+	assert(a.GetSize() == b.GetSize());
+	out.Resize(a.GetSize());
+	GetKernels(kernel).compose(
+		GetStreams(a).data(), GetStreams(b).data(), GetStreams(out).data(), out.GetStride());
+}
+
+void InverseTransforms(const TransformArray& xforms, TransformArray& out, TransformKernel kernel) {
+	out.Resize(xforms.GetSize());
+	GetKernels(kernel).inverse(GetStreams(xforms).data(), GetStreams(out).data(), out.GetStride());
+}
+
+void ApplyTransforms(const TransformArray& xforms,
+					 const VectorArray& vecs,
+					 VectorArray& out,
+					 TransformKernel kernel) {
+	assert(xforms.GetSize() == vecs.GetSize());
+	out.Resize(vecs.GetSize());
+	GetKernels(kernel).apply(
+		GetStreams(xforms).data(), GetStreams(vecs).data(), GetStreams(out).data(), out.GetStride());
+}
+} // namespace TransformBatch
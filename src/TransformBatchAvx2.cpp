@@ -0,0 +1,38 @@
+/*
+SSE NIF Optimizer
+See the included LICENSE file
+*/
+
+// Built with AVX2 enabled, nothing in here may run before TransformBatch checked the CPU for it
+
+#include "TransformKernels.hpp"
+
+#ifdef __AVX2__
+#include <immintrin.h>
+
+namespace {
+struct AvxLane {
+	static constexpr size_t Width = 8;
+	__m256 v;
+
+	static AvxLane Load(const float* p) { return {_mm256_loadu_ps(p)}; }
+	static AvxLane Set(float f) { return {_mm256_set1_ps(f)}; }
+	void Store(float* p) const { _mm256_storeu_ps(p, v); }
+
+	friend AvxLane operator+(AvxLane a, AvxLane b) { return {_mm256_add_ps(a.v, b.v)}; }
+	friend AvxLane operator-(AvxLane a, AvxLane b) { return {_mm256_sub_ps(a.v, b.v)}; }
+	friend AvxLane operator*(AvxLane a, AvxLane b) { return {_mm256_mul_ps(a.v, b.v)}; }
+	friend AvxLane operator/(AvxLane a, AvxLane b) { return {_mm256_div_ps(a.v, b.v)}; }
+};
+} // namespace
+#endif
+
+namespace TransformKernels {
+const KernelTable* GetAvx2Kernels() {
+#ifdef __AVX2__
+	return &GetKernels<AvxLane>();
+#else
+	return nullptr;
+#endif
+}
+} // namespace TransformKernels
@@ -0,0 +1,232 @@
+/*
+SSE NIF Optimizer
+See the included LICENSE file
+*/
+
+// Checks the per-vertex influence limit and the bone x vertex weight matrix, which decide the vertex
+// weights that are written back to skinned shapes.
+
+#include "SkinWeights.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <utility>
+#include <vector>
+
+namespace {
+using Row = std::vector<std::pair<uint16_t, float>>;
+
+class Test {
+public:
+	void Check(bool passed, const char* what, int line) {
+		if (passed)
+			return;
+
+		std::fprintf(stderr, "FAILED: %s (line %d)\n", what, line);
+		failures++;
+	}
+
+	int GetFailures() const { return failures; }
+
+private:
+	int failures = 0;
+};
+
+#define CHECK(test, expr) (test).Check((expr), #expr, __LINE__)
+
+bool Near(float a, float b) {
+	return std::fabs(a - b) <= 1e-6f;
+}
+
+// Bones and weights in slot order
+bool IsInfluences(const VertexInfluences& influences,
+				  const std::vector<std::pair<uint8_t, float>>& expected) {
+	if (influences.count != static_cast<int>(expected.size()))
+		return false;
+
+	for (int i = 0; i < influences.count; i++) {
+		if (influences.bones[i] != expected[i].first || !Near(influences.weights[i], expected[i].second))
+			return false;
+	}
+
+	return true;
+}
+
+Row GetRow(const SkinWeights& matrix, size_t bone) {
+	SkinWeights::BoneRow row = matrix.GetBone(bone);
+
+	Row result;
+	for (size_t i = 0; i < row.size; i++)
+		result.emplace_back(row.vertices[i], row.weights[i]);
+	return result;
+}
+
+// Four bones over eight vertices:
+// bone 0: vertices 0, 1, bone 1: 1, 2, 5, bone 2: none, bone 3: 6, 7
+SkinWeights MakeMatrix() {
+	SkinWeights matrix;
+	matrix.AddBone({{0, 1.0f}, {1, 0.5f}});
+	matrix.AddBone({{5, 0.25f}, {2, 1.0f}, {1, 0.5f}});
+	matrix.AddBone({});
+	matrix.AddBone({{7, 1.0f}, {6, 0.75f}});
+	return matrix;
+}
+
+void TestInfluenceOrder(Test& test) {
+	VertexInfluences influences;
+	influences.Add(1, 0.2f);
+	influences.Add(2, 0.5f);
+	influences.Add(3, 0.2f);
+	influences.Add(4, 0.1f);
+
+	// Sorted by weight, of equal weights the later one comes first
+	CHECK(test, IsInfluences(influences, {{2, 0.5f}, {3, 0.2f}, {1, 0.2f}, {4, 0.1f}}));
+}
+
+void TestInfluenceLimit(Test& test) {
+	VertexInfluences influences;
+	influences.Add(1, 0.1f);
+	influences.Add(2, 0.4f);
+	influences.Add(3, 0.3f);
+	influences.Add(4, 0.2f);
+	influences.Add(5, 0.05f);
+	CHECK(test, IsInfluences(influences, {{2, 0.4f}, {3, 0.3f}, {4, 0.2f}, {1, 0.1f}}));
+
+	influences.Add(6, 0.35f);
+	CHECK(test, IsInfluences(influences, {{2, 0.4f}, {6, 0.35f}, {3, 0.3f}, {4, 0.2f}}));
+
+	// A tie with the weakest drops the one added first
+	influences.Add(7, 0.2f);
+	CHECK(test, IsInfluences(influences, {{2, 0.4f}, {6, 0.35f}, {3, 0.3f}, {7, 0.2f}}));
+
+	// The kept four add up to one
+	const float sum = 0.4f + 0.35f + 0.3f + 0.2f;
+	influences.Normalize();
+	CHECK(test,
+		  IsInfluences(influences, {{2, 0.4f / sum}, {6, 0.35f / sum}, {3, 0.3f / sum}, {7, 0.2f / sum}}));
+
+	VertexInfluences ties;
+	for (uint8_t bone = 1; bone <= 6; bone++)
+		ties.Add(bone, 0.25f);
+	CHECK(test, IsInfluences(ties, {{6, 0.25f}, {5, 0.25f}, {4, 0.25f}, {3, 0.25f}}));
+}
+
+void TestZeroWeights(Test& test) {
+	VertexInfluences influences;
+	influences.Add(1, 0.0f);
+	influences.Add(2, 0.0f);
+	CHECK(test, influences.count == 0);
+
+	// Nothing to scale, no division by zero
+	influences.Normalize();
+	CHECK(test, influences.count == 0);
+	CHECK(test, influences.weights[0] == 0.0f);
+
+	influences.Add(3, 0.5f);
+	influences.Add(4, 0.0f);
+	influences.Normalize();
+	CHECK(test, IsInfluences(influences, {{3, 1.0f}}));
+
+	// Zero weights and repeats of a bone within a vertex aren't in the matrix
+	struct Vertex {
+		float weights[4];
+		uint8_t bones[4];
+	};
+
+	const Vertex vertices[] = {
+		{{0.0f, 0.0f, 0.0f, 0.0f}, {0, 1, 0, 2}},
+		{{0.5f, 0.5f, 0.0f, 0.0f}, {1, 1, 0, 0}},
+	};
+	SkinWeights matrix;
+	matrix.SetFromVertices(3, 2, 4, vertices[0].bones, vertices[0].weights, sizeof(Vertex));
+	CHECK(test, matrix.GetBoneCount() == 3);
+	CHECK(test, matrix.GetInfluenceCount() == 1);
+	CHECK(test, GetRow(matrix, 0).empty());
+	CHECK(test, (GetRow(matrix, 1) == Row{{1, 0.5f}}));
+	CHECK(test, !matrix.HasInfluence(0));
+	CHECK(test, !matrix.HasInfluence(2));
+}
+
+void TestRemapBones(Test& test) {
+	SkinWeights matrix = MakeMatrix();
+	CHECK(test, matrix.GetInfluenceCount() == 7);
+	CHECK(test, (GetRow(matrix, 1) == Row{{1, 0.5f}, {2, 1.0f}, {5, 0.25f}}));
+	CHECK(test, matrix.GetVertexEnd() == 8);
+
+	// First bone
+	SkinWeights first = MakeMatrix();
+	first.RemapBones({-1, 0, 1, 2});
+	CHECK(test, first.GetBoneCount() == 3);
+	CHECK(test, first.GetInfluenceCount() == 5);
+	CHECK(test, (GetRow(first, 0) == Row{{1, 0.5f}, {2, 1.0f}, {5, 0.25f}}));
+	CHECK(test, GetRow(first, 1).empty());
+	CHECK(test, (GetRow(first, 2) == Row{{6, 0.75f}, {7, 1.0f}}));
+
+	// Last bone, bones past the end of the map are kept
+	SkinWeights last = MakeMatrix();
+	last.RemapBones({0, 1, 2, -1});
+	CHECK(test, last.GetBoneCount() == 3);
+	CHECK(test, last.GetInfluenceCount() == 5);
+	CHECK(test, (GetRow(last, 0) == Row{{0, 1.0f}, {1, 0.5f}}));
+	CHECK(test, last.GetVertexEnd() == 6);
+
+	SkinWeights shortMap = MakeMatrix();
+	shortMap.RemapBones({-1});
+	CHECK(test, shortMap.GetBoneCount() == 3);
+	CHECK(test, (GetRow(shortMap, 2) == Row{{6, 0.75f}, {7, 1.0f}}));
+
+	// All bones
+	SkinWeights all = MakeMatrix();
+	all.RemapBones({-1, -1, -1, -1});
+	CHECK(test, all.GetBoneCount() == 0);
+	CHECK(test, all.GetInfluenceCount() == 0);
+	CHECK(test, all.GetVertexEnd() == 0);
+	CHECK(test, GetRow(all, 0).empty());
+
+	// Same result as removing the bones one by one
+	SkinWeights removed = MakeMatrix();
+	removed.RemoveBone(2);
+	removed.RemoveBone(0);
+	SkinWeights remapped = MakeMatrix();
+	remapped.RemapBones({-1, 0, -1, 1});
+	CHECK(test, removed.GetBoneCount() == remapped.GetBoneCount());
+	for (size_t bone = 0; bone < removed.GetBoneCount(); bone++)
+		CHECK(test, GetRow(removed, bone) == GetRow(remapped, bone));
+}
+
+void TestRemapVertices(Test& test) {
+	// Vertex 0 is dropped, 1 and 2 swap, vertices from 3 on move down by one
+	SkinWeights matrix = MakeMatrix();
+	matrix.RemapVertices({-1, 2, 1}, -1);
+	CHECK(test, matrix.GetBoneCount() == 4);
+	CHECK(test, matrix.GetInfluenceCount() == 6);
+	CHECK(test, (GetRow(matrix, 0) == Row{{2, 0.5f}}));
+	CHECK(test, (GetRow(matrix, 1) == Row{{1, 1.0f}, {2, 0.5f}, {4, 0.25f}}));
+	CHECK(test, GetRow(matrix, 2).empty());
+	CHECK(test, (GetRow(matrix, 3) == Row{{5, 0.75f}, {6, 1.0f}}));
+
+	// Dropping every vertex leaves empty rows
+	SkinWeights none = MakeMatrix();
+	none.RemapVertices(std::vector<int>(8, -1), 0);
+	CHECK(test, none.GetBoneCount() == 4);
+	CHECK(test, none.GetInfluenceCount() == 0);
+	CHECK(test, none.GetVertexEnd() == 0);
+}
+} // namespace
+
+int main() {
+	Test test;
+	TestInfluenceOrder(test);
+	TestInfluenceLimit(test);
+	TestZeroWeights(test);
+	TestRemapBones(test);
+	TestRemapVertices(test);
+
+	if (test.GetFailures() > 0) {
+		std::fprintf(stderr, "%d check(s) failed\n", test.GetFailures());
+		return 1;
+	}
+
+	std::printf("All checks passed\n");
+	return 0;
+}
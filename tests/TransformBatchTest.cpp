@@ -0,0 +1,193 @@
+/*
+SSE NIF Optimizer
+See the included LICENSE file
+*/
+
+// Checks every kernel of TransformBatch the CPU supports against the MatTransform functions of nifly.
+// Every size up to 100 covers all paddings of all lane widths, run it under AddressSanitizer for overruns.
+
+#include "TransformBatch.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+using namespace nifly;
+
+namespace {
+constexpr float Tolerance = 1e-4f;
+
+// SplitMix64, so that every compiler tests the same transforms
+class Random {
+public:
+	explicit Random(uint64_t seed)
+		: state(seed) {}
+
+	float Float(float min, float max) {
+		uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+		z ^= z >> 31;
+		return min + (max - min) * static_cast<float>(z >> 40) / 16777216.0f;
+	}
+
+	Vector3 Vec(float min, float max) { return Vector3(Float(min, max), Float(min, max), Float(min, max)); }
+
+	MatTransform Transform() {
+		MatTransform xform;
+		for (int r = 0; r < 3; r++)
+			xform.rotation[r] = Vec(-2.0f, 2.0f);
+		xform.translation = Vec(-100.0f, 100.0f);
+		xform.scale = Float(0.5f, 2.0f);
+		return xform;
+	}
+
+private:
+	uint64_t state;
+};
+
+MatTransform Identity() {
+	MatTransform xform;
+	xform.rotation[0] = Vector3(1.0f, 0.0f, 0.0f);
+	xform.rotation[1] = Vector3(0.0f, 1.0f, 0.0f);
+	xform.rotation[2] = Vector3(0.0f, 0.0f, 1.0f);
+	xform.translation = Vector3();
+	xform.scale = 1.0f;
+	return xform;
+}
+
+// Relative to the magnitude, translations of composed transforms get large
+bool Near(float a, float b) {
+	return std::fabs(a - b) <= Tolerance * std::max(1.0f, std::fabs(b));
+}
+
+bool Near(const Vector3& a, const Vector3& b) {
+	return Near(a.x, b.x) && Near(a.y, b.y) && Near(a.z, b.z);
+}
+
+bool Near(const MatTransform& a, const MatTransform& b) {
+	for (int r = 0; r < 3; r++) {
+		if (!Near(a.rotation[r], b.rotation[r]))
+			return false;
+	}
+	return Near(a.translation, b.translation) && Near(a.scale, b.scale);
+}
+
+class Test {
+public:
+	void Check(bool passed, const char* what, TransformKernel kernel, size_t size, size_t index) {
+		if (passed)
+			return;
+
+		std::fprintf(stderr,
+					 "FAILED: %s, kernel %s, size %zu, element %zu\n",
+					 what,
+					 TransformBatch::GetKernelName(kernel),
+					 size,
+					 index);
+		failures++;
+	}
+
+	int GetFailures() const { return failures; }
+
+private:
+	int failures = 0;
+};
+
+void TestKernel(Test& test, TransformKernel kernel) {
+	Random random(static_cast<uint64_t>(kernel) + 1);
+	for (size_t size = 0; size <= 100; size++) {
+		std::vector<MatTransform> a(size), b(size);
+		std::vector<Vector3> vecs(size);
+		TransformArray aArray(size), bArray(size);
+		VectorArray vecArray(size);
+		for (size_t i = 0; i < size; i++) {
+			a[i] = random.Transform();
+			b[i] = random.Transform();
+			vecs[i] = random.Vec(-100.0f, 100.0f);
+			aArray.Set(i, a[i]);
+			bArray.Set(i, b[i]);
+			vecArray.Set(i, vecs[i]);
+		}
+
+		TransformArray composed, inverted;
+		VectorArray applied;
+		TransformBatch::ComposeTransforms(aArray, bArray, composed, kernel);
+		TransformBatch::InverseTransforms(aArray, inverted, kernel);
+		TransformBatch::ApplyTransforms(aArray, vecArray, applied, kernel);
+
+		test.Check(composed.GetSize() == size, "compose size", kernel, size, 0);
+		test.Check(inverted.GetSize() == size, "inverse size", kernel, size, 0);
+		test.Check(applied.GetSize() == size, "apply size", kernel, size, 0);
+
+		for (size_t i = 0; i < size; i++) {
+			test.Check(Near(composed.Get(i), a[i].ComposeTransforms(b[i])), "compose", kernel, size, i);
+			test.Check(Near(inverted.Get(i), a[i].InverseTransform()), "inverse", kernel, size, i);
+			test.Check(Near(applied.Get(i), a[i].ApplyTransform(vecs[i])), "apply", kernel, size, i);
+		}
+
+		// Output aliasing an input
+		TransformArray inPlace = aArray;
+		TransformBatch::ComposeTransforms(inPlace, bArray, inPlace, kernel);
+		for (size_t i = 0; i < size; i++)
+			test.Check(Near(inPlace.Get(i), a[i].ComposeTransforms(b[i])),
+					   "compose in place",
+					   kernel,
+					   size,
+					   i);
+
+		inPlace = bArray;
+		TransformBatch::ComposeTransforms(aArray, inPlace, inPlace, kernel);
+		for (size_t i = 0; i < size; i++)
+			test.Check(Near(inPlace.Get(i), a[i].ComposeTransforms(b[i])),
+					   "compose in place",
+					   kernel,
+					   size,
+					   i);
+
+		inPlace = aArray;
+		TransformBatch::InverseTransforms(inPlace, inPlace, kernel);
+		for (size_t i = 0; i < size; i++)
+			test.Check(Near(inPlace.Get(i), a[i].InverseTransform()), "inverse in place", kernel, size, i);
+
+		VectorArray vecInPlace = vecArray;
+		TransformBatch::ApplyTransforms(aArray, vecInPlace, vecInPlace, kernel);
+		for (size_t i = 0; i < size; i++)
+			test.Check(Near(vecInPlace.Get(i), a[i].ApplyTransform(vecs[i])),
+					   "apply in place",
+					   kernel,
+					   size,
+					   i);
+
+		// Growing keeps the transforms and adds identities
+		composed.Resize(size + 5);
+		for (size_t i = 0; i < size + 5; i++) {
+			const MatTransform expected = i < size ? a[i].ComposeTransforms(b[i]) : Identity();
+			test.Check(Near(composed.Get(i), expected), "resize", kernel, size, i);
+		}
+	}
+}
+} // namespace
+
+int main() {
+	Test test;
+	for (TransformKernel kernel : {TransformKernel::Scalar, TransformKernel::SSE2, TransformKernel::AVX2}) {
+		if (!TransformBatch::IsSupported(kernel)) {
+			std::printf("%s: not supported, skipped\n", TransformBatch::GetKernelName(kernel));
+			continue;
+		}
+
+		TestKernel(test, kernel);
+		std::printf("%s: tested\n", TransformBatch::GetKernelName(kernel));
+	}
+
+	if (test.GetFailures() > 0) {
+		std::fprintf(stderr, "%d check(s) failed\n", test.GetFailures());
+		return 1;
+	}
+
+	std::printf("All checks passed\n");
+	return 0;
+}